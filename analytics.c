@@ -0,0 +1,266 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "analytics.h"
+#include "intmap.h"
+#include "lane.h"
+
+static DaySketch* day_sketches = NULL;
+static int day_sketch_count = 0;
+static int day_sketch_capacity = 0;
+static IntMap day_index;             // day -> index in day_sketches
+
+static ItemDaySketch* item_day_sketches = NULL;
+static int item_day_sketch_count = 0;
+static int item_day_sketch_capacity = 0;
+static IntMap item_day_index;        // (item_id << 32 | day) -> index
+
+static HourBucket hourly[7][24];      // [weekday][hour], Sunday = 0
+
+static int digests_loaded = 0;       // amounts came from receipt_digests.dat
+static int digests_cover = 0;        // receipts already folded into those digests
+
+int date_key(const char* date) {
+    int year, month, day;
+    if (sscanf(date, "%d-%d-%d", &year, &month, &day) != 3) {
+        return 0;
+    }
+    return year * 10000 + month * 100 + day;
+}
+
+// A refund takes its amount off the hour it was given in, without
+// counting as a transaction
+static void record_hour(const Receipt* receipt) {
+    if (receipt->timestamp == 0) {
+        return;
+    }
+    time_t t = (time_t)receipt->timestamp;
+    struct tm tm = *localtime(&t);
+    hourly[tm.tm_wday][tm.tm_hour].transactions += receipt->refund_of[0] == '\0';
+    hourly[tm.tm_wday][tm.tm_hour].sales += receipt->total_amount;
+}
+
+static void* grow_array(void* array, int* capacity, size_t element_size) {
+    *capacity = *capacity ? *capacity * 2 : 64;
+    array = realloc(array, *capacity * element_size);
+    if (array == NULL) {
+        out_of_memory_locked("growing sales aggregates");
+    }
+    return array;
+}
+
+static DaySketch* day_sketch(int day) {
+    int inserted;
+    int64_t* slot = intmap_upsert(&day_index, (uint32_t)day, &inserted);
+    if (!inserted) {
+        return &day_sketches[*slot];
+    }
+    if (day_sketch_count == day_sketch_capacity) {
+        day_sketches = grow_array(day_sketches, &day_sketch_capacity, sizeof(DaySketch));
+    }
+    *slot = day_sketch_count;
+    DaySketch* sketch = &day_sketches[day_sketch_count++];
+    sketch->day = day;
+    hll_init(&sketch->customers);
+    tdigest_init(&sketch->amounts);
+    return sketch;
+}
+
+static ItemDaySketch* item_day_sketch(int item_id, int day) {
+    int inserted;
+    uint64_t key = ((uint64_t)(uint32_t)item_id << 32) | (uint32_t)day;
+    int64_t* slot = intmap_upsert(&item_day_index, key, &inserted);
+    if (!inserted) {
+        return &item_day_sketches[*slot];
+    }
+    if (item_day_sketch_count == item_day_sketch_capacity) {
+        item_day_sketches = grow_array(item_day_sketches, &item_day_sketch_capacity, sizeof(ItemDaySketch));
+    }
+    *slot = item_day_sketch_count;
+    ItemDaySketch* sketch = &item_day_sketches[item_day_sketch_count++];
+    sketch->item_id = item_id;
+    sketch->day = day;
+    compact_hll_init(&sketch->customers);
+    return sketch;
+}
+
+static void add_item_day_customer(int item_id, int day, uint64_t customer_hash) {
+    if (!compact_hll_add(&item_day_sketch(item_id, day)->customers, customer_hash)) {
+        out_of_memory_locked("growing sales aggregates");
+    }
+}
+
+// Refunds only reach the hourly sales: the customer was already counted
+// by the sale, and a negative amount is not a basket
+void analytics_record_receipt(const Receipt* receipt, const ReceiptDetail* details, int detail_count) {
+    record_hour(receipt);
+    if (receipt->refund_of[0] != '\0') {
+        return;
+    }
+    int day = date_key(receipt->date);
+    uint64_t customer_hash = intmap_hash((uint64_t)(uint32_t)receipt->customer_id);
+
+    DaySketch* sketch = day_sketch(day);
+    hll_add(&sketch->customers, customer_hash);
+    tdigest_add(&sketch->amounts, money_to_double(receipt->total_amount), 1);
+    for (int i = 0; i < detail_count; i++) {
+        add_item_day_customer(details[i].item_id, day, customer_hash);
+    }
+}
+
+// File format: a "receipts,N" line giving how many receipts the digests
+// cover, then per day a "day,centroids,min,max" line followed by one
+// "mean,weight" line per centroid. Files without the first line cover
+// every receipt on file.
+static int load_digests() {
+    FILE *file = fopen("data/receipt_digests.dat", "r");
+    if (file == NULL) {
+        return 0;
+    }
+
+    if (fscanf(file, "receipts,%d\n", &digests_cover) != 1) {
+        digests_cover = receipt_count;
+    }
+
+    int day, centroid_count;
+    double min, max;
+    while (fscanf(file, "%d,%d,%lf,%lf\n", &day, &centroid_count, &min, &max) == 4) {
+        DaySketch* sketch = day_sketch(day);
+        for (int i = 0; i < centroid_count; i++) {
+            double mean, weight;
+            if (fscanf(file, "%lf,%lf\n", &mean, &weight) != 2) {
+                break;
+            }
+            tdigest_add(&sketch->amounts, mean, weight);
+        }
+        sketch->amounts.min = min;
+        sketch->amounts.max = max;
+    }
+
+    fclose(file);
+    return 1;
+}
+
+void analytics_save_digests() {
+    FILE *file = fopen("data/receipt_digests.dat", "w");
+    if (file == NULL) {
+        printf("Error: Cannot save receipt digests to file.\n");
+        return;
+    }
+
+    fprintf(file, "receipts,%d\n", receipt_count);
+    for (int i = 0; i < day_sketch_count; i++) {
+        TDigest* digest = &day_sketches[i].amounts;
+        if (digest->total_weight == 0) {
+            continue;
+        }
+        tdigest_compress(digest);
+        fprintf(file, "%d,%d,%.17g,%.17g\n", day_sketches[i].day, digest->count, digest->min, digest->max);
+        for (int j = 0; j < digest->count; j++) {
+            fprintf(file, "%.17g,%.17g\n", digest->centroids[j].mean, digest->centroids[j].weight);
+        }
+    }
+
+    fclose(file);
+}
+
+void analytics_rebuild() {
+    if (day_index.capacity == 0) {
+        intmap_init(&day_index, 64);
+        intmap_init(&item_day_index, 1024);
+    }
+    intmap_clear(&day_index);
+    intmap_clear(&item_day_index);
+    for (int i = 0; i < item_day_sketch_count; i++) {
+        compact_hll_free(&item_day_sketches[i].customers);
+    }
+    day_sketch_count = 0;
+    item_day_sketch_count = 0;
+    memset(hourly, 0, sizeof(hourly));
+
+    // Amount digests are persisted; only derive them from history when the
+    // digest file is missing (e.g. data written by an older version), and
+    // for receipts appended since the digests were last saved
+    digests_loaded = load_digests();
+
+    // Receipt number -> receipt index, to attach detail lines to their header
+    IntMap by_number;
+    intmap_init(&by_number, receipt_count * 2);
+    for (int i = 0; i < receipt_count; i++) {
+        int num;
+        record_hour(&receipts[i]);
+        if (receipts[i].refund_of[0] != '\0') {
+            continue;
+        }
+        if (sscanf(receipts[i].receipt_id, "R%d", &num) == 1) {
+            intmap_put(&by_number, (uint32_t)num, i);
+        }
+        DaySketch* sketch = day_sketch(date_key(receipts[i].date));
+        hll_add(&sketch->customers, intmap_hash((uint64_t)(uint32_t)receipts[i].customer_id));
+        if (!digests_loaded || i >= digests_cover) {
+            tdigest_add(&sketch->amounts, money_to_double(receipts[i].total_amount), 1);
+        }
+    }
+
+    for (int i = 0; i < receipt_detail_count; i++) {
+        int num;
+        if (sscanf(receipt_details[i].receipt_id, "R%d", &num) != 1) {
+            continue;
+        }
+        int64_t* index = intmap_get(&by_number, (uint32_t)num);
+        if (index == NULL) {
+            continue;
+        }
+        const Receipt* receipt = &receipts[*index];
+        add_item_day_customer(receipt_details[i].item_id, date_key(receipt->date),
+                              intmap_hash((uint64_t)(uint32_t)receipt->customer_id));
+    }
+    intmap_free(&by_number);
+}
+
+// Merges the customer sketches for [from_day, to_day] into out, optionally
+// restricted to one item (item_id 0 means all items). Returns the number of
+// days with sales in the range.
+int analytics_distinct_customers(int from_day, int to_day, int item_id, HyperLogLog* out) {
+    int days = 0;
+    hll_init(out);
+
+    if (item_id == 0) {
+        for (int i = 0; i < day_sketch_count; i++) {
+            if (day_sketches[i].day >= from_day && day_sketches[i].day <= to_day) {
+                hll_merge(out, &day_sketches[i].customers);
+                days++;
+            }
+        }
+    } else {
+        for (int i = 0; i < item_day_sketch_count; i++) {
+            const ItemDaySketch* sketch = &item_day_sketches[i];
+            if (sketch->item_id == item_id && sketch->day >= from_day && sketch->day <= to_day) {
+                compact_hll_merge_into(out, &sketch->customers);
+                days++;
+            }
+        }
+    }
+    return days;
+}
+
+// Merges the receipt-amount digests for [from_day, to_day] into out.
+// Returns the number of days with sales in the range.
+int analytics_amount_distribution(int from_day, int to_day, TDigest* out) {
+    int days = 0;
+    tdigest_init(out);
+
+    for (int i = 0; i < day_sketch_count; i++) {
+        if (day_sketches[i].day >= from_day && day_sketches[i].day <= to_day &&
+            day_sketches[i].amounts.total_weight > 0) {
+            tdigest_merge(out, &day_sketches[i].amounts);
+            days++;
+        }
+    }
+    return days;
+}
+
+const HourBucket (*analytics_hourly_heatmap())[24] {
+    return (const HourBucket (*)[24])hourly;
+}
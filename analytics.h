@@ -0,0 +1,39 @@
+#ifndef ANALYTICS_H
+#define ANALYTICS_H
+
+#include "report.h"
+#include "sketch.h"
+
+// Incrementally maintained sales aggregates. Rebuilt from the receipt
+// history at load time and updated by generate_receipt() afterwards,
+// so reports read them without scanning receipts.
+
+typedef struct {
+    int day;                  // YYYYMMDD
+    HyperLogLog customers;
+    TDigest amounts;          // receipt totals, persisted in receipt_digests.dat
+} DaySketch;
+
+// Most items sell to a few customers a day, so these stay compact
+typedef struct {
+    int item_id;
+    int day;                  // YYYYMMDD
+    CompactHyperLogLog customers;
+} ItemDaySketch;
+
+// Weekday x hour-of-day bucket, local time
+typedef struct {
+    long transactions;
+    money_t sales;
+} HourBucket;
+
+// Function prototypes
+int date_key(const char* date);
+void analytics_rebuild();
+void analytics_record_receipt(const Receipt* receipt, const ReceiptDetail* details, int detail_count);
+int analytics_distinct_customers(int from_day, int to_day, int item_id, HyperLogLog* out);
+int analytics_amount_distribution(int from_day, int to_day, TDigest* out);
+void analytics_save_digests();
+const HourBucket (*analytics_hourly_heatmap())[24];
+
+#endif
@@ -0,0 +1,272 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "batch.h"
+#include "item.h"
+#include "customer.h"
+#include "report.h"
+#include "lane.h"
+#include "journal.h"
+#include "intmap.h"
+
+// Wholesale order files: "ORDER,<customer id>" starts an order and each
+// following "<item id>,<quantity>" line adds to it. Blank lines and lines
+// starting with # are skipped.
+
+typedef struct {
+    int item_id;
+    int quantity;
+    int line_number;
+    int item_index;           // in items[], found by validate_orders()
+} OrderLine;
+
+typedef struct {
+    int customer_id;
+    int line_number;          // of the ORDER line, used in messages
+    int first_line;           // index into OrderBatch.lines
+    int line_count;
+    int valid;
+} Order;
+
+typedef struct {
+    Order* orders;
+    int order_count;
+    int order_capacity;
+    OrderLine* lines;
+    int line_count;
+    int line_capacity;
+} OrderBatch;
+
+static void* grow(void* array, int* capacity, int needed, size_t size) {
+    if (needed <= *capacity) {
+        return array;
+    }
+    int bigger = *capacity > 0 ? *capacity * 2 : 64;
+    array = realloc(array, (size_t)bigger * size);
+    if (array == NULL) {
+        printf("Error: Out of memory reading orders.\n");
+        exit(1);
+    }
+    *capacity = bigger;
+    return array;
+}
+
+static int read_orders(const char* path, OrderBatch* batch) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        printf("Error: Cannot open order file %s.\n", path);
+        return 0;
+    }
+
+    char text[128];
+    int line_number = 0;
+    int current = -1;
+    while (fgets(text, sizeof(text), file) != NULL) {
+        line_number++;
+        if (text[0] == '#' || text[0] == '\n' || text[0] == '\r') {
+            continue;
+        }
+
+        int a, b;
+        if (sscanf(text, "ORDER,%d", &a) == 1) {
+            batch->orders = grow(batch->orders, &batch->order_capacity,
+                                 batch->order_count + 1, sizeof(Order));
+            current = batch->order_count++;
+            Order* order = &batch->orders[current];
+            order->customer_id = a;
+            order->line_number = line_number;
+            order->first_line = batch->line_count;
+            order->line_count = 0;
+            order->valid = 1;
+        } else if (current >= 0 && sscanf(text, "%d,%d", &a, &b) == 2) {
+            batch->lines = grow(batch->lines, &batch->line_capacity,
+                                batch->line_count + 1, sizeof(OrderLine));
+            OrderLine* line = &batch->lines[batch->line_count++];
+            line->item_id = a;
+            line->quantity = b;
+            line->line_number = line_number;
+            batch->orders[current].line_count++;
+        } else if (current >= 0) {
+            printf("Order at line %d: cannot read line %d.\n", batch->orders[current].line_number, line_number);
+            batch->orders[current].valid = 0;
+        } else {
+            printf("Warning: Ignoring line %d before the first ORDER.\n", line_number);
+        }
+    }
+
+    fclose(file);
+    return 1;
+}
+
+static int compare_item_id(const void* a, const void* b) {
+    const OrderLine* x = a;
+    const OrderLine* y = b;
+    return (x->item_id > y->item_id) - (x->item_id < y->item_id);
+}
+
+// Checks every order against the catalog and customer list with one hash
+// lookup per line, then sorts each order by item id and merges repeated
+// items so stock is touched once per item, in catalog-id order. Orders
+// are then checked against the stock left by the valid orders before
+// them, so one that cannot be filled is reported here rather than
+// failing halfway through the checkout pass.
+static void validate_orders(OrderBatch* batch) {
+    IntMap catalog, known_customers, demand;
+    intmap_init(&catalog, item_count * 2);
+    for (int i = 0; i < item_count; i++) {
+        intmap_put(&catalog, (uint64_t)items[i].id, i);
+    }
+    intmap_init(&known_customers, customer_count * 2);
+    for (int i = 0; i < customer_count; i++) {
+        intmap_put(&known_customers, (uint64_t)customers[i].id, i);
+    }
+    intmap_init(&demand, item_count * 2);
+
+    for (int o = 0; o < batch->order_count; o++) {
+        Order* order = &batch->orders[o];
+        OrderLine* lines = &batch->lines[order->first_line];
+
+        if (intmap_get(&known_customers, (uint64_t)order->customer_id) == NULL) {
+            printf("Order at line %d: customer %d not found.\n", order->line_number, order->customer_id);
+            order->valid = 0;
+        }
+        for (int i = 0; i < order->line_count; i++) {
+            int64_t* index = intmap_get(&catalog, (uint64_t)lines[i].item_id);
+            if (index == NULL) {
+                printf("Order at line %d: item %d on line %d not found.\n",
+                       order->line_number, lines[i].item_id, lines[i].line_number);
+                order->valid = 0;
+                continue;
+            }
+            lines[i].item_index = (int)*index;
+            if (lines[i].quantity <= 0) {
+                printf("Order at line %d: quantity on line %d must be positive.\n",
+                       order->line_number, lines[i].line_number);
+                order->valid = 0;
+            }
+        }
+        if (!order->valid) {
+            continue;
+        }
+
+        qsort(lines, order->line_count, sizeof(OrderLine), compare_item_id);
+        int merged = 0;
+        for (int i = 0; i < order->line_count; i++) {
+            if (merged > 0 && lines[merged - 1].item_id == lines[i].item_id) {
+                lines[merged - 1].quantity += lines[i].quantity;
+            } else {
+                lines[merged++] = lines[i];
+            }
+        }
+        order->line_count = merged;
+
+        if (order->line_count == 0) {
+            printf("Order at line %d has no items.\n", order->line_number);
+            order->valid = 0;
+            continue;
+        }
+
+        for (int i = 0; i < order->line_count; i++) {
+            const Item* item = &items[lines[i].item_index];
+            int64_t* taken = intmap_get(&demand, (uint64_t)lines[i].item_id);
+            int left = item->available - (taken ? (int)*taken : 0);
+            if (lines[i].quantity > left) {
+                printf("Order at line %d: %d of item %d wanted, only %d left in stock.\n",
+                       order->line_number, lines[i].quantity, lines[i].item_id, left);
+                order->valid = 0;
+            }
+        }
+        if (order->valid) {
+            for (int i = 0; i < order->line_count; i++) {
+                *intmap_upsert(&demand, (uint64_t)lines[i].item_id, NULL) += lines[i].quantity;
+            }
+        }
+    }
+
+    intmap_free(&catalog);
+    intmap_free(&known_customers);
+    intmap_free(&demand);
+}
+
+// Lists the line numbers of the orders that were not checked out
+static void report_skipped(const OrderBatch* batch) {
+    int skipped = 0;
+    for (int o = 0; o < batch->order_count; o++) {
+        if (!batch->orders[o].valid) {
+            printf(skipped++ == 0 ? "Skipped orders at lines %d" : ", %d", batch->orders[o].line_number);
+        }
+    }
+    if (skipped > 0) {
+        printf(".\n");
+    }
+}
+
+// Checks out every valid order in the file on a lane of its own. The
+// receipts go to the journal without waiting on the disk for each one;
+// the whole batch is flushed once and written to the data files in a
+// single checkpoint at the end. Returns the number of receipts written,
+// or -1 if the journal could not be flushed, in which case none of them
+// are saved. Sets order_count to the number of orders read.
+int ingest_order_file(const char* path, int* order_count) {
+    static Lane lane;
+    OrderBatch batch;
+    memset(&batch, 0, sizeof(batch));
+    *order_count = 0;
+
+    if (!read_orders(path, &batch)) {
+        return 0;
+    }
+    validate_orders(&batch);
+    *order_count = batch.order_count;
+
+    int completed = 0;
+    journal_begin_batch();
+    for (int o = 0; o < batch.order_count; o++) {
+        Order* order = &batch.orders[o];
+        if (!order->valid) {
+            continue;
+        }
+
+        lane.customer = find_customer_by_id(order->customer_id);
+        const OrderLine* lines = &batch.lines[order->first_line];
+        int filled = 1;
+        for (int i = 0; i < order->line_count && filled; i++) {
+            // The catalog does not change during the batch, so the index
+            // validate_orders() looked up still names the item
+            Item* item = &items[lines[i].item_index];
+            filled = reserve_stock(item, lines[i].quantity);
+            if (filled) {
+                add_reserved_to_cart(&lane.cart, item, lines[i].quantity);
+            } else {
+                printf("Insufficient stock! Available: %d\n", __atomic_load_n(&item->available, __ATOMIC_RELAXED));
+            }
+        }
+
+        Receipt receipt;
+        if (!filled || !generate_receipt(&lane, &receipt, 0)) {
+            printf("Order at line %d rejected.\n", order->line_number);
+            order->valid = 0;
+            clear_cart(&lane.cart);
+            continue;
+        }
+
+        char amount[MONEY_STR_LEN];
+        printf("Order at line %d: %s for customer %d, %d items, $%s\n",
+               order->line_number, receipt.receipt_id, receipt.customer_id,
+               order->line_count, money_format(receipt.total_amount, amount));
+        completed++;
+    }
+    report_skipped(&batch);
+
+    if (!journal_end_batch()) {
+        completed = -1;
+    } else {
+        lock_store();
+        checkpoint_store();
+        unlock_store();
+    }
+
+    free(batch.orders);
+    free(batch.lines);
+    return completed;
+}
@@ -0,0 +1,7 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+// Function prototypes
+int ingest_order_file(const char* path, int* order_count);
+
+#endif
@@ -1,190 +1,361 @@
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
 #include "console_status.h"
+#include "lane.h"
+#include "pricing.h"
+
+// The panel is drawn into a grid of cells and compared with the grid
+// already on the terminal; only cells that differ are sent, as one
+// write(). That needs the panel to stay put, so on a terminal tall
+// enough its rows are kept out of the scroll region and menus scroll
+// below it. Otherwise (a short terminal, or output that is not a
+// terminal) the panel scrolls with the text as it always has, and every
+// frame is sent in full.
+#define MIN_SCROLL_ROWS 12        // rows left for menus below a fixed panel
+
+// Colours a cell can have; index into style_codes
+enum { STYLE_PLAIN, STYLE_CYAN, STYLE_GREEN, STYLE_YELLOW, STYLE_MAGENTA, STYLE_RED };
+static const char* const style_codes[] = {
+    "\033[0m", "\033[36m", "\033[32m", "\033[33m", "\033[35m", "\033[31m"
+};
+
+typedef struct {
+    char glyph[4];                // one UTF-8 character, not terminated
+    unsigned char length;
+    unsigned char style;
+} Cell;
+
+typedef Cell Frame[STATUS_PANEL_HEIGHT][STATUS_PANEL_WIDTH];
+
+static Frame next_frame;          // being drawn
+static Frame shown_frame;         // on the terminal
+static int shown_valid = 0;       // 0 until the terminal holds a known frame
+static int panel_fixed = 0;       // the panel rows are outside the scroll region
+
+// Worst case is every other cell changing: a cursor move, a colour code
+// and a 4-byte glyph each
+#define FRAME_BUFFER_SIZE (64 + STATUS_PANEL_HEIGHT * STATUS_PANEL_WIDTH * 20)
+static char frame_buffer[FRAME_BUFFER_SIZE];
+
+static void write_all(const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(STDOUT_FILENO, data, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        data += written;
+        length -= (size_t)written;
+    }
+}
+
+static void restore_terminal() {
+    write_all("\033[r", 3);
+}
 
-#define RESET       "\033[0m"
-#define RED         "\033[31m"
-#define GREEN       "\033[32m"
-#define YELLOW      "\033[33m"
-#define BLUE        "\033[34m"
-#define MAGENTA     "\033[35m"
-#define CYAN        "\033[36m"
-#define WHITE       "\033[37m"
-#define BOLD        "\033[1m"
-#define UNDERLINE   "\033[4m"
-
-// Global status variables
-static char current_screen[50] = "Main Menu";
-static Customer* selected_customer = NULL;
-static char last_message[100] = "System Ready";
-static char last_receipt_id[20] = "None";
-static float last_transaction_amount = 0.0;
+static void interrupted(int signal_number) {
+    (void)signal_number;
+    restore_terminal();
+    _exit(130);
+}
 
 void init_console_status() {
     // Initialize console for status display
     printf("\033[2J\033[1;1H"); // Clear screen and move to top-left
     printf("XYZ Retail Store Billing System - Console Mode\n");
+
+    struct winsize size;
+    int below = STATUS_START_ROW + STATUS_PANEL_HEIGHT;
+    panel_fixed = isatty(STDOUT_FILENO) && ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 &&
+                  size.ws_row >= below + MIN_SCROLL_ROWS;
+    if (panel_fixed) {
+        // Scroll only the rows below the panel, and start there
+        printf("\033[%d;r\033[%d;1H", below, below);
+        atexit(restore_terminal);
+        signal(SIGINT, interrupted);
+    }
     printf("Status panel will appear in the top-right corner.\n\n");
+    fflush(stdout);
+    shown_valid = 0;
 }
 
 void clear_status_area() {
     // Clear the status panel area
+    SAVE_CURSOR();
     for (int row = STATUS_START_ROW; row < STATUS_START_ROW + STATUS_PANEL_HEIGHT; row++) {
         MOVE_CURSOR(row, STATUS_START_COL);
         CLEAR_LINE();
     }
+    RESTORE_CURSOR();
+    fflush(stdout);
+    for (int row = 0; row < STATUS_PANEL_HEIGHT; row++) {
+        for (int col = 0; col < STATUS_PANEL_WIDTH; col++) {
+            Cell* cell = &shown_frame[row][col];
+            cell->glyph[0] = ' ';
+            cell->length = 1;
+            cell->style = STYLE_PLAIN;
+        }
+    }
+    shown_valid = 1;
 }
 
-void display_status_panel() {
-    SAVE_CURSOR();
-    clear_status_area();
+// Writes text into the frame from (row, col), clipped at limit columns.
+// A UTF-8 sequence cut short by the end of the string or by a byte that
+// does not continue it takes one cell as U+FFFD, and only the bytes it
+// actually had are consumed. Returns the column after the last character
+// written.
+static int put_text(int row, int col, int limit, int style, const char* text) {
+    const unsigned char* p = (const unsigned char*)text;
+    while (*p != '\0' && col < limit) {
+        int length = *p < 0x80 ? 1 : *p >= 0xf0 ? 4 : *p >= 0xe0 ? 3 : *p >= 0xc0 ? 2 : 0;
+        int copied = length > 0 ? 1 : 0;
+        while (copied < length && (p[copied] & 0xc0) == 0x80) {
+            copied++;
+        }
+        Cell* cell = &next_frame[row][col++];
+        memset(cell->glyph, 0, sizeof(cell->glyph));
+        if (length > 0 && copied == length) {
+            memcpy(cell->glyph, p, length);
+            cell->length = (unsigned char)length;
+        } else {
+            memcpy(cell->glyph, "\xef\xbf\xbd", 3);
+            cell->length = 3;
+            copied = copied > 0 ? copied : 1;
+        }
+        // Colour does not show on a space, so spaces never count as changed
+        cell->style = *p == ' ' ? STYLE_PLAIN : (unsigned char)style;
+        p += copied;
+    }
+    return col;
+}
+
+static void put_border(int row, const char* line) {
+    put_text(row, 0, STATUS_PANEL_WIDTH, STYLE_CYAN, line);
+}
+
+// "│ <label><value>   │" with the label and value in their own colours
+static void put_row(int row, int label_style, const char* label, int value_style, const char* value) {
+    put_text(row, 0, STATUS_PANEL_WIDTH, STYLE_PLAIN,
+             "│                                 │");
+    next_frame[row][0].style = STYLE_CYAN;
+    next_frame[row][STATUS_PANEL_WIDTH - 1].style = STYLE_CYAN;
+    int col = put_text(row, 2, STATUS_PANEL_WIDTH - 2, label_style, label);
+    put_text(row, col, STATUS_PANEL_WIDTH - 2, value_style, value);
+}
+
+static void blank_row(int row) {
+    put_text(row, 0, STATUS_PANEL_WIDTH, STYLE_PLAIN, "                                   ");
+}
+
+static int same_cell(const Cell* a, const Cell* b) {
+    return a->length == b->length && a->style == b->style &&
+           memcmp(a->glyph, b->glyph, a->length) == 0;
+}
+
+// Sends the cells of next_frame that differ from shown_frame, moving the
+// cursor only across unchanged cells and switching colour only when it
+// changes.
+static void flush_frame() {
+    char* out = frame_buffer;
+    if (!panel_fixed) {
+        shown_valid = 0;          // the text may have scrolled the old frame away
+    }
+    int cursor_row = -1, cursor_col = -1;
+    int style = -1;
+
+    for (int row = 0; row < STATUS_PANEL_HEIGHT; row++) {
+        for (int col = 0; col < STATUS_PANEL_WIDTH; col++) {
+            const Cell* cell = &next_frame[row][col];
+            if (shown_valid && same_cell(cell, &shown_frame[row][col])) {
+                continue;
+            }
+            if (out == frame_buffer) {
+                out += sprintf(out, "\033[s");
+            }
+            if (row != cursor_row || col != cursor_col) {
+                out += sprintf(out, "\033[%d;%dH", STATUS_START_ROW + row, STATUS_START_COL + col);
+                cursor_row = row;
+            }
+            if (cell->style != style) {
+                out += sprintf(out, "%s", style_codes[cell->style]);
+                style = cell->style;
+            }
+            memcpy(out, cell->glyph, cell->length);
+            out += cell->length;
+            cursor_col = col + 1;
+        }
+    }
+    if (out == frame_buffer) {
+        return;
+    }
+    if (style != STYLE_PLAIN) {
+        out += sprintf(out, "%s", style_codes[STYLE_PLAIN]);
+    }
+    out += sprintf(out, "\033[u");
 
-    int row = STATUS_START_ROW;
+    // Anything printed through stdio must reach the terminal first
+    fflush(stdout);
+    write_all(frame_buffer, (size_t)(out - frame_buffer));
+    memcpy(shown_frame, next_frame, sizeof(Frame));
+    shown_valid = 1;
+}
+
+// The panel shows the state of the lane driven by this console
+void display_status_panel() {
+    Lane* lane = current_lane;
+    const Cart* cart = &lane->cart;
+    char text[40];
+    int row = 0;
 
     // Header
-    MOVE_CURSOR(row++, STATUS_START_COL);
-    printf("%s┌─── STATUS PANEL ───────────────┐%s", CYAN, RESET);
+    put_border(row++, "┌─── STATUS PANEL ────────────────┐");
 
     // Current time
-    MOVE_CURSOR(row++, STATUS_START_COL);
     time_t now = time(NULL);
     struct tm* tm_info = localtime(&now);
-    char time_str[20];
-    strftime(time_str, sizeof(time_str), "%H:%M:%S", tm_info);
-    printf("%s│%s Time: %s%-22s%s │", CYAN, RESET, YELLOW, time_str, RESET);
+    strftime(text, sizeof(text), "%H:%M:%S", tm_info);
+    put_row(row++, STYLE_PLAIN, "Time: ", STYLE_YELLOW, text);
 
-    MOVE_CURSOR(row++, STATUS_START_COL);
-    printf("%s├─────────────────────────────────┤%s", CYAN, RESET);
+    put_border(row++, "├─────────────────────────────────┤");
 
     // Current screen
-    MOVE_CURSOR(row++, STATUS_START_COL);
-    printf("%s│%s Screen: %s%-22s%s │", CYAN, RESET, GREEN, current_screen, RESET);
+    put_row(row++, STYLE_PLAIN, "Screen: ", STYLE_GREEN, lane->current_screen);
 
-    MOVE_CURSOR(row++, STATUS_START_COL);
-    printf("%s├─────────────────────────────────┤%s", CYAN, RESET);
+    put_border(row++, "├─────────────────────────────────┤");
 
     // Customer info
-    MOVE_CURSOR(row++, STATUS_START_COL);
-    printf("%s│ CUSTOMER:%s                       │", CYAN, RESET);
-
-    if (selected_customer) {
-        MOVE_CURSOR(row++, STATUS_START_COL);
-        printf("%s│%s ID: %s%-26d%s │", CYAN, RESET, YELLOW, selected_customer->id, RESET);
-
-        MOVE_CURSOR(row++, STATUS_START_COL);
-        char name_truncated[23];
-        strncpy(name_truncated, selected_customer->name, 22);
-        name_truncated[22] = '\0';
-        printf("%s│%s Name: %s%-24s%s │", CYAN, RESET, GREEN, name_truncated, RESET);
-
-        MOVE_CURSOR(row++, STATUS_START_COL);
-        char phone_truncated[23];
-        strncpy(phone_truncated, selected_customer->phone, 22);
-        phone_truncated[22] = '\0';
-        printf("%s│%s Phone: %s%-23s%s │", CYAN, RESET, MAGENTA, phone_truncated, RESET);
+    put_row(row++, STYLE_CYAN, "CUSTOMER:", STYLE_PLAIN, "");
+    if (lane->customer) {
+        snprintf(text, sizeof(text), "%d", lane->customer->id);
+        put_row(row++, STYLE_PLAIN, "ID: ", STYLE_YELLOW, text);
+        put_row(row++, STYLE_PLAIN, "Name: ", STYLE_GREEN, lane->customer->name);
+        put_row(row++, STYLE_PLAIN, "Phone: ", STYLE_MAGENTA, lane->customer->phone);
     } else {
-        MOVE_CURSOR(row++, STATUS_START_COL);
-        printf("%s│%s %sNo customer selected%s            │", CYAN, RESET, RED, RESET);
-        row += 2;
+        put_row(row++, STYLE_PLAIN, "", STYLE_RED, "No customer selected");
+        put_row(row++, STYLE_PLAIN, "", STYLE_PLAIN, "");
+        put_row(row++, STYLE_PLAIN, "", STYLE_PLAIN, "");
     }
 
-    MOVE_CURSOR(row++, STATUS_START_COL);
-    printf("%s├─────────────────────────────────┤%s", CYAN, RESET);
+    put_border(row++, "├─────────────────────────────────┤");
 
     // Cart status
-    MOVE_CURSOR(row++, STATUS_START_COL);
-    printf("%s│ CART:%s                           │", CYAN, RESET);
-
-    if (is_cart_empty()) {
-        MOVE_CURSOR(row++, STATUS_START_COL);
-        printf("%s│%s %sEmpty%s                           │", CYAN, RESET, RED, RESET);
+    put_row(row++, STYLE_CYAN, "CART:", STYLE_PLAIN, "");
+    if (is_cart_empty(cart)) {
+        put_row(row++, STYLE_PLAIN, "", STYLE_RED, "Empty");
     } else {
-        MOVE_CURSOR(row++, STATUS_START_COL);
-        printf("%s│%s Items: %s%-24d%s │", CYAN, RESET, YELLOW, cart.count, RESET);
-
-        MOVE_CURSOR(row++, STATUS_START_COL);
-        printf("%s│%s Total: %s$%-22.2f%s │", CYAN, RESET, GREEN, get_cart_total(), RESET);
+        char amount[MONEY_STR_LEN];
+        snprintf(text, sizeof(text), "%d lines, %d units", cart->count, get_cart_units(cart));
+        put_row(row++, STYLE_PLAIN, "Items: ", STYLE_YELLOW, text);
+
+        // Priced as checkout will price it, so this matches the receipt
+        PricingResult pricing;
+        price_cart(cart, lane->customer, &pricing);
+        snprintf(text, sizeof(text), "$%s", money_format(pricing.total, amount));
+        put_row(row++, STYLE_PLAIN, "Total: ", STYLE_GREEN, text);
+
+        snprintf(text, sizeof(text), "$%s", money_format(pricing.promotions + pricing.discount, amount));
+        put_row(row++, STYLE_PLAIN, "Savings: ", STYLE_MAGENTA, text);
     }
 
-    MOVE_CURSOR(row++, STATUS_START_COL);
-    printf("%s├─────────────────────────────────┤%s", CYAN, RESET);
+    put_border(row++, "├─────────────────────────────────┤");
 
     // Last transaction
-    MOVE_CURSOR(row++, STATUS_START_COL);
-    printf("%s│ LAST TRANSACTION:%s               │", CYAN, RESET);
-
-    if (strcmp(last_receipt_id, "None") != 0) {
-        MOVE_CURSOR(row++, STATUS_START_COL);
-        printf("%s│%s ID: %s%-26s%s │", CYAN, RESET, YELLOW, last_receipt_id, RESET);
-
-        MOVE_CURSOR(row++, STATUS_START_COL);
-        printf("%s│%s Amount: %s$%-20.2f%s │", CYAN, RESET, GREEN, last_transaction_amount, RESET);
+    put_row(row++, STYLE_CYAN, "LAST TRANSACTION:", STYLE_PLAIN, "");
+    if (strcmp(lane->last_receipt_id, "None") != 0) {
+        char amount[MONEY_STR_LEN];
+        put_row(row++, STYLE_PLAIN, "ID: ", STYLE_YELLOW, lane->last_receipt_id);
+        snprintf(text, sizeof(text), "$%s", money_format(lane->last_transaction_amount, amount));
+        put_row(row++, STYLE_PLAIN, "Amount: ", STYLE_GREEN, text);
     } else {
-        MOVE_CURSOR(row++, STATUS_START_COL);
-        printf("%s│%s %sNo transactions yet%s             │", CYAN, RESET, RED, RESET);
-        row++;
+        put_row(row++, STYLE_PLAIN, "", STYLE_RED, "No transactions yet");
+        put_row(row++, STYLE_PLAIN, "", STYLE_PLAIN, "");
     }
 
-    MOVE_CURSOR(row++, STATUS_START_COL);
-    printf("%s├─────────────────────────────────┤%s", CYAN, RESET);
+    put_border(row++, "├─────────────────────────────────┤");
 
     // Status message
-    MOVE_CURSOR(row++, STATUS_START_COL);
-    char msg_truncated[30];
-    strncpy(msg_truncated, last_message, 29);
-    msg_truncated[29] = '\0';
-    printf("%s│ %s%-31s%s │", CYAN, GREEN, msg_truncated, RESET);
+    put_row(row++, STYLE_PLAIN, "", STYLE_GREEN, lane->last_message);
 
-    MOVE_CURSOR(row++, STATUS_START_COL);
-    printf("%s└─────────────────────────────────┘%s", CYAN, RESET);
+    put_border(row++, "└─────────────────────────────────┘");
 
-    RESTORE_CURSOR();
-    fflush(stdout);
+    // An empty cart is two rows shorter; blank what is left below
+    while (row < STATUS_PANEL_HEIGHT) {
+        blank_row(row++);
+    }
+
+    flush_frame();
+}
+
+// Redraws the panel on a timer so its clock keeps time. Only done where
+// the panel is fixed: there the redraw is a few changed cells, while a
+// scrolling panel would be drawn in full over the text every tick.
+void tick_status_panel() {
+    if (panel_fixed) {
+        display_status_panel();
+    }
 }
 
 void update_current_screen(const char* screen_name) {
+    Lane* lane = current_lane;
     if (screen_name) {
-        strncpy(current_screen, screen_name, sizeof(current_screen) - 1);
-        current_screen[sizeof(current_screen) - 1] = '\0';
+        strncpy(lane->current_screen, screen_name, sizeof(lane->current_screen) - 1);
+        lane->current_screen[sizeof(lane->current_screen) - 1] = '\0';
         display_status_panel();
     }
 }
 
 void update_selected_customer(Customer* customer) {
-    selected_customer = customer;
+    Lane* lane = current_lane;
+    lane->customer = customer;
     if (customer) {
-        snprintf(last_message, sizeof(last_message), "Customer selected: %s", customer->name);
+        snprintf(lane->last_message, sizeof(lane->last_message), "Customer selected: %s", customer->name);
     } else {
-        strcpy(last_message, "No customer selected");
+        strcpy(lane->last_message, "No customer selected");
     }
     display_status_panel();
 }
 
 void update_cart_status() {
-    if (is_cart_empty()) {
-        strcpy(last_message, "Cart is empty");
+    Lane* lane = current_lane;
+    const Cart* cart = &lane->cart;
+    if (is_cart_empty(cart)) {
+        strcpy(lane->last_message, "Cart is empty");
     } else {
-        snprintf(last_message, sizeof(last_message), "Cart: %d items, $%.2f", cart.count, get_cart_total());
+        char total[MONEY_STR_LEN];
+        PricingResult pricing;
+        price_cart(cart, lane->customer, &pricing);
+        snprintf(lane->last_message, sizeof(lane->last_message), "Cart: %d items, $%s", cart->count,
+                 money_format(pricing.total, total));
     }
     display_status_panel();
 }
 
-void update_last_transaction(const char* receipt_id, float amount) {
+void update_last_transaction(const char* receipt_id, money_t amount) {
+    Lane* lane = current_lane;
     if (receipt_id) {
-        strncpy(last_receipt_id, receipt_id, sizeof(last_receipt_id) - 1);
-        last_receipt_id[sizeof(last_receipt_id) - 1] = '\0';
-        last_transaction_amount = amount;
-        snprintf(last_message, sizeof(last_message), "Receipt %s: $%.2f", receipt_id, amount);
+        strncpy(lane->last_receipt_id, receipt_id, sizeof(lane->last_receipt_id) - 1);
+        lane->last_receipt_id[sizeof(lane->last_receipt_id) - 1] = '\0';
+        lane->last_transaction_amount = amount;
+        char total[MONEY_STR_LEN];
+        snprintf(lane->last_message, sizeof(lane->last_message), "Receipt %s: $%s", receipt_id, money_format(amount, total));
         display_status_panel();
     }
 }
 
 void show_status_message(const char* message) {
+    Lane* lane = current_lane;
     if (message) {
-        strncpy(last_message, message, sizeof(last_message) - 1);
-        last_message[sizeof(last_message) - 1] = '\0';
+        strncpy(lane->last_message, message, sizeof(lane->last_message) - 1);
+        lane->last_message[sizeof(lane->last_message) - 1] = '\0';
         display_status_panel();
     }
-}
\ No newline at end of file
+}
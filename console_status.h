@@ -8,10 +8,11 @@
 void init_console_status();
 void clear_status_area();
 void display_status_panel();
+void tick_status_panel();
 void update_current_screen(const char* screen_name);
 void update_selected_customer(Customer* customer);
 void update_cart_status();
-void update_last_transaction(const char* receipt_id, float amount);
+void update_last_transaction(const char* receipt_id, money_t amount);
 void show_status_message(const char* message);
 
 // ANSI escape codes for cursor positioning
@@ -26,7 +27,7 @@ void show_status_message(const char* message);
 // Console dimensions and status panel area
 #define CONSOLE_WIDTH 120
 #define STATUS_PANEL_WIDTH 35
-#define STATUS_PANEL_HEIGHT 20
+#define STATUS_PANEL_HEIGHT 21
 #define STATUS_START_COL (CONSOLE_WIDTH - STATUS_PANEL_WIDTH + 1)
 #define STATUS_START_ROW 1
 
@@ -2,11 +2,14 @@
 #include <stdlib.h>
 #include <string.h>
 #include "customer.h"
+#include "data_version.h"
+#include "lane.h"
+#include "input.h"
+#include "pager.h"
 
 // Global variables
 Customer customers[MAX_CUSTOMERS];
 int customer_count = 0;
-Customer* current_customer = NULL;
 
 void load_customers() {
     FILE *file = fopen("data/customers.dat", "r");
@@ -67,21 +70,50 @@ void save_customers() {
     fclose(file);
 }
 
-void display_all_customers() {
-    printf("\n==================================================\n");
-    printf("                 ALL CUSTOMERS\n");
-    printf("==================================================\n");
-    printf("%-5s %-20s %-15s %-25s\n", "ID", "Name", "Phone", "Email");
-    printf("--------------------------------------------------\n");
-    
-    for (int i = 0; i < customer_count; i++) {
-        printf("%-5d %-20s %-15s %-25s\n", 
-               customers[i].id, 
-               customers[i].name, 
-               customers[i].phone, 
-               customers[i].email);
+static int customer_rows() {
+    return customer_count;
+}
+
+static int customer_row_id(int index) {
+    return customers[index].id;
+}
+
+static void format_customer_row(int index, char* out, size_t size) {
+    snprintf(out, size, "%-5d %-20s %-15s %-25s",
+             customers[index].id,
+             customers[index].name,
+             customers[index].phone,
+             customers[index].email);
+}
+
+static int compare_customers(int column, int a, int b) {
+    switch (column) {
+        case 0: return (customers[a].id > customers[b].id) - (customers[a].id < customers[b].id);
+        case 1: return strcmp(customers[a].name, customers[b].name);
+        case 2: return strcmp(customers[a].phone, customers[b].phone);
+        default: return strcmp(customers[a].email, customers[b].email);
     }
-    printf("==================================================\n");
+}
+
+static unsigned long customer_sort_changed_at(int column) {
+    (void)column;
+    return data_changed_at(DATA_CUSTOMERS, 0);
+}
+
+static PagerSource customer_pages = {
+    .title = "ALL CUSTOMERS",
+    .header = "ID    Name                 Phone           Email",
+    .columns = {"ID", "Name", "Phone", "Email"},
+    .column_count = 4,
+    .changed_at = customer_sort_changed_at,
+    .count = customer_rows,
+    .row_id = customer_row_id,
+    .format_row = format_customer_row,
+    .compare = compare_customers
+};
+
+void display_all_customers() {
+    page_view(&customer_pages);
 }
 
 void search_customers(const char* query) {
@@ -143,25 +175,24 @@ void add_customer() {
     
     printf("Enter customer details:\n");
     printf("Name: ");
-    fgets(new_customer.name, MAX_NAME_LEN, stdin);
-    new_customer.name[strcspn(new_customer.name, "\n")] = 0; // Remove newline
+    read_line(new_customer.name, MAX_NAME_LEN);
     
     printf("Phone: ");
-    fgets(new_customer.phone, MAX_PHONE_LEN, stdin);
-    new_customer.phone[strcspn(new_customer.phone, "\n")] = 0;
+    read_line(new_customer.phone, MAX_PHONE_LEN);
     
     printf("Email: ");
-    fgets(new_customer.email, MAX_EMAIL_LEN, stdin);
-    new_customer.email[strcspn(new_customer.email, "\n")] = 0;
+    read_line(new_customer.email, MAX_EMAIL_LEN);
     
     printf("Address: ");
-    fgets(new_customer.address, MAX_ADDRESS_LEN, stdin);
-    new_customer.address[strcspn(new_customer.address, "\n")] = 0;
+    read_line(new_customer.address, MAX_ADDRESS_LEN);
     
+    lock_store();
     customers[customer_count] = new_customer;
     customer_count++;
+    data_changed(DATA_CUSTOMERS, new_customer.id);
     
     save_customers();
+    unlock_store();
     
     printf("Customer added successfully! ID: %d\n", new_customer.id);
 }
\ No newline at end of file
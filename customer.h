@@ -26,6 +26,5 @@ void add_customer();
 // Global variables
 extern Customer customers[MAX_CUSTOMERS];
 extern int customer_count;
-extern Customer* current_customer;
 
 #endif
\ No newline at end of file
@@ -0,0 +1,37 @@
+#include <stdint.h>
+#include "data_version.h"
+#include "intmap.h"
+
+static unsigned long global_version = 1;
+static unsigned long domain_versions[DATA_DOMAIN_COUNT];
+static IntMap scope_versions;        // (domain << 32 | scope) -> version
+
+static uint64_t scope_key(DataDomain domain, int scope) {
+    return ((uint64_t)domain << 32) | (uint32_t)scope;
+}
+
+// scope 0 marks the whole domain changed without recording a key
+void data_changed(DataDomain domain, int scope) {
+    global_version++;
+    domain_versions[domain] = global_version;
+    if (scope != 0) {
+        if (scope_versions.capacity == 0) {
+            intmap_init(&scope_versions, 256);
+        }
+        intmap_put(&scope_versions, scope_key(domain, scope), (int64_t)global_version);
+    }
+}
+
+// Version at which (domain, scope) last changed; scope 0 asks about any
+// change in the domain
+unsigned long data_changed_at(DataDomain domain, int scope) {
+    if (scope == 0) {
+        return domain_versions[domain];
+    }
+    int64_t* version = intmap_get(&scope_versions, scope_key(domain, scope));
+    return version ? (unsigned long)*version : 0;
+}
+
+unsigned long data_version() {
+    return global_version;
+}
@@ -0,0 +1,23 @@
+#ifndef DATA_VERSION_H
+#define DATA_VERSION_H
+
+// Change tracking for cached reports. Every mutation bumps one global
+// counter and stamps the domain (and optionally one key inside it, such
+// as a day or a customer id) with the new value. A cached result built
+// at version V is still valid if none of its inputs changed after V.
+typedef enum {
+    DATA_ITEMS,                  // catalog: ids, names, prices
+    DATA_ITEM_STOCK,             // stock on hand; scope: item id
+    DATA_CUSTOMERS,
+    DATA_RECEIPTS,
+    DATA_RECEIPTS_BY_DAY,        // scope: YYYYMMDD
+    DATA_RECEIPTS_BY_CUSTOMER,   // scope: customer id
+    DATA_DOMAIN_COUNT
+} DataDomain;
+
+// Function prototypes
+void data_changed(DataDomain domain, int scope);
+unsigned long data_changed_at(DataDomain domain, int scope);
+unsigned long data_version();
+
+#endif
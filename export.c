@@ -0,0 +1,212 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "export.h"
+
+static void flush_buffer(Exporter* out) {
+    if (out->used > 0) {
+        fwrite(out->buffer, 1, out->used, out->file);
+        out->used = 0;
+    }
+}
+
+// Callers reserve room before writing; no single field is anywhere near
+// the buffer size, so a flush always makes enough space.
+static char* reserve(Exporter* out, size_t bytes) {
+    if (out->used + bytes > EXPORT_BUFFER_SIZE) {
+        flush_buffer(out);
+    }
+    return out->buffer + out->used;
+}
+
+static void put_char(Exporter* out, char c) {
+    *reserve(out, 1) = c;
+    out->used++;
+}
+
+static void put_raw(Exporter* out, const char* text, size_t length) {
+    memcpy(reserve(out, length), text, length);
+    out->used += length;
+}
+
+static void put_unsigned(Exporter* out, unsigned long long value) {
+    char digits[20];
+    int n = 0;
+    do {
+        digits[n++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+
+    char* p = reserve(out, n);
+    for (int i = 0; i < n; i++) {
+        p[i] = digits[n - 1 - i];
+    }
+    out->used += n;
+}
+
+static void put_signed(Exporter* out, long long value) {
+    if (value < 0) {
+        put_char(out, '-');
+        put_unsigned(out, 0ULL - (unsigned long long)value);
+    } else {
+        put_unsigned(out, (unsigned long long)value);
+    }
+}
+
+static void put_quoted(Exporter* out, const char* value) {
+    put_char(out, '"');
+    for (const char* p = value; *p; p++) {
+        unsigned char c = (unsigned char)*p;
+        if (out->format == EXPORT_CSV) {
+            if (c == '"') put_char(out, '"');
+            put_char(out, (char)c);
+        } else if (c == '"' || c == '\\') {
+            put_char(out, '\\');
+            put_char(out, (char)c);
+        } else if (c < 0x20) {
+            static const char hex[] = "0123456789abcdef";
+            char escape[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 15]};
+            put_raw(out, escape, sizeof(escape));
+        } else {
+            put_char(out, (char)c);
+        }
+    }
+    put_char(out, '"');
+}
+
+// Writes the separator and, for JSON, the key of the next field
+static void field_prefix(Exporter* out) {
+    if (out->format == EXPORT_CSV) {
+        if (out->field > 0) put_char(out, ',');
+    } else {
+        put_raw(out, out->field > 0 ? ",\"" : "{\"", 2);
+        const char* name = out->field < out->column_count ? out->columns[out->field] : "field";
+        put_raw(out, name, strlen(name));
+        put_raw(out, "\":", 2);
+    }
+    out->field++;
+}
+
+int export_open(Exporter* out, const char* path, ExportFormat format) {
+    memset(out, 0, sizeof(*out));
+    out->file = fopen(path, "wb");
+    if (out->file == NULL) {
+        printf("Error: Cannot open %s for export.\n", path);
+        return 0;
+    }
+    out->buffer = malloc(EXPORT_BUFFER_SIZE);
+    if (out->buffer == NULL) {
+        fclose(out->file);
+        printf("Error: Out of memory allocating export buffer.\n");
+        return 0;
+    }
+    out->format = format;
+    out->owns_file = 1;
+    return 1;
+}
+
+// Writes rows to a stream that is already open, such as stdout.
+// export_close() flushes it but leaves it open.
+int export_attach(Exporter* out, FILE* file, ExportFormat format) {
+    memset(out, 0, sizeof(*out));
+    out->buffer = malloc(EXPORT_BUFFER_SIZE);
+    if (out->buffer == NULL) {
+        printf("Error: Out of memory allocating export buffer.\n");
+        return 0;
+    }
+    out->file = file;
+    out->format = format;
+    return 1;
+}
+
+// Hands everything written so far to the stream, for a reader waiting on it
+int export_flush(Exporter* out) {
+    flush_buffer(out);
+    return fflush(out->file) == 0;
+}
+
+int export_close(Exporter* out) {
+    flush_buffer(out);
+    int ok = !ferror(out->file);
+    ok = (out->owns_file ? fclose(out->file) : fflush(out->file)) == 0 && ok;
+    free(out->buffer);
+    out->buffer = NULL;
+    if (!ok) {
+        printf("Error: Writing export file failed.\n");
+    }
+    return ok;
+}
+
+void export_columns(Exporter* out, const char* const* columns, int count) {
+    out->columns = columns;
+    out->column_count = count;
+    if (out->format == EXPORT_CSV) {
+        for (int i = 0; i < count; i++) {
+            if (i > 0) put_char(out, ',');
+            put_raw(out, columns[i], strlen(columns[i]));
+        }
+        put_char(out, '\n');
+    }
+}
+
+void export_row_begin(Exporter* out) {
+    out->field = 0;
+}
+
+void export_row_end(Exporter* out) {
+    if (out->format == EXPORT_JSONL) {
+        put_char(out, '}');
+    }
+    put_char(out, '\n');
+    out->rows++;
+}
+
+void export_str(Exporter* out, const char* value) {
+    field_prefix(out);
+    // CSV only needs quotes when the value contains a delimiter
+    if (out->format == EXPORT_CSV && strpbrk(value, ",\"\n") == NULL) {
+        put_raw(out, value, strlen(value));
+    } else {
+        put_quoted(out, value);
+    }
+}
+
+void export_int(Exporter* out, long long value) {
+    field_prefix(out);
+    put_signed(out, value);
+}
+
+void export_fixed(Exporter* out, double value, int decimals) {
+    field_prefix(out);
+
+    long long scale = 1;
+    for (int i = 0; i < decimals; i++) {
+        scale *= 10;
+    }
+    long long scaled = (long long)(value * scale + (value < 0 ? -0.5 : 0.5));
+    if (scaled < 0) {
+        put_char(out, '-');
+        scaled = -scaled;
+    }
+    put_unsigned(out, (unsigned long long)(scaled / scale));
+    if (decimals > 0) {
+        put_char(out, '.');
+        long long fraction = scaled % scale;
+        for (long long digit = scale / 10; digit > 0; digit /= 10) {
+            put_char(out, (char)('0' + fraction / digit % 10));
+        }
+    }
+}
+
+// Exact: money is already an integer count of minor units
+void export_money(Exporter* out, money_t value) {
+    field_prefix(out);
+    unsigned long long magnitude = value < 0 ? 0ULL - (unsigned long long)value : (unsigned long long)value;
+    if (value < 0) {
+        put_char(out, '-');
+    }
+    put_unsigned(out, magnitude / MONEY_SCALE);
+    put_char(out, '.');
+    put_char(out, (char)('0' + magnitude % MONEY_SCALE / 10));
+    put_char(out, (char)('0' + magnitude % 10));
+}
@@ -0,0 +1,42 @@
+#ifndef EXPORT_H
+#define EXPORT_H
+
+#include <stdio.h>
+#include "money.h"
+
+// Streaming row writer for report exports. Rows are formatted by hand into
+// one reusable buffer that is flushed with fwrite() whenever it fills, so
+// memory use does not depend on the number of rows.
+#define EXPORT_BUFFER_SIZE (1 << 20)
+
+typedef enum {
+    EXPORT_CSV,
+    EXPORT_JSONL
+} ExportFormat;
+
+typedef struct {
+    FILE* file;
+    ExportFormat format;
+    char* buffer;
+    size_t used;
+    const char* const* columns;
+    int column_count;
+    int field;                // index of the next field in the current row
+    long rows;
+    int owns_file;            // 0 when writing to a stream opened elsewhere
+} Exporter;
+
+// Function prototypes
+int export_open(Exporter* out, const char* path, ExportFormat format);
+int export_attach(Exporter* out, FILE* file, ExportFormat format);
+int export_flush(Exporter* out);
+int export_close(Exporter* out);
+void export_columns(Exporter* out, const char* const* columns, int count);
+void export_row_begin(Exporter* out);
+void export_row_end(Exporter* out);
+void export_str(Exporter* out, const char* value);
+void export_int(Exporter* out, long long value);
+void export_fixed(Exporter* out, double value, int decimals);
+void export_money(Exporter* out, money_t value);
+
+#endif
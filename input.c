@@ -0,0 +1,201 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include "input.h"
+
+typedef struct {
+    void (*run)();
+    int interval_ms;
+    long long due;            // monotonic milliseconds
+} InputTask;
+
+static InputTask tasks[MAX_INPUT_TASKS];
+static int task_count = 0;
+
+// Bytes read but not yet consumed; a pipe may deliver several lines at once
+static char pending[4096];
+static int pending_start = 0;
+static int pending_end = 0;
+
+static long long now_ms() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+// Runs task every interval_ms while the console waits for input. Tasks
+// run between keystrokes, never during one, so they must not read input
+// and should only print through the status panel. Returns 0 if the task
+// table is full.
+int input_every(int interval_ms, void (*task)()) {
+    if (task_count == MAX_INPUT_TASKS || interval_ms <= 0) {
+        return 0;
+    }
+    tasks[task_count].run = task;
+    tasks[task_count].interval_ms = interval_ms;
+    tasks[task_count].due = now_ms() + interval_ms;
+    task_count++;
+    return 1;
+}
+
+// Runs the tasks that are due and returns how long poll() may wait for
+// the next one, or -1 if there are none
+static int run_due_tasks() {
+    long long now = now_ms();
+    long long next = -1;
+    for (int i = 0; i < task_count; i++) {
+        if (tasks[i].due <= now) {
+            tasks[i].run();
+            now = now_ms();
+            tasks[i].due = now + tasks[i].interval_ms;
+        }
+        if (next < 0 || tasks[i].due < next) {
+            next = tasks[i].due;
+        }
+    }
+    return next < 0 ? -1 : (int)(next - now > 0 ? next - now : 0);
+}
+
+// Waits for input, running tasks meanwhile. Returns 0 at end of input.
+static int fill_pending() {
+    while (1) {
+        int timeout = run_due_tasks();
+        fflush(stdout);
+        struct pollfd fd = {STDIN_FILENO, POLLIN, 0};
+        int ready = poll(&fd, 1, timeout);
+        if (ready < 0 && errno != EINTR) {
+            return 0;
+        }
+        if (ready <= 0) {
+            continue;
+        }
+        ssize_t got = read(STDIN_FILENO, pending, sizeof(pending));
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return 0;
+        }
+        pending_start = 0;
+        pending_end = (int)got;
+        return 1;
+    }
+}
+
+// Editing keys on a terminal
+#define KEY_INTERRUPT 0x03
+#define KEY_EOF 0x04
+#define KEY_BACKSPACE 0x08
+#define KEY_KILL_LINE 0x15
+#define KEY_ESCAPE 0x1b
+#define KEY_DELETE 0x7f
+
+static void erase_chars(char* buffer, int* length, int count) {
+    while (count-- > 0 && *length > 0) {
+        // Drop a whole UTF-8 character
+        do {
+            (*length)--;
+        } while (*length > 0 && (buffer[*length] & 0xc0) == 0x80);
+        fputs("\b \b", stdout);
+    }
+}
+
+// Reads one line into buffer without its newline, truncated to fit. On
+// a terminal the line is edited in raw mode: printable keys are echoed,
+// Backspace and Ctrl-U erase, arrow and other escape sequences are
+// ignored, and Ctrl-D on an empty line ends input. Elsewhere the line is
+// taken as it comes. At end of input the program exits.
+void read_line(char* buffer, int size) {
+    int terminal = isatty(STDIN_FILENO);
+    struct termios saved, raw;
+    if (terminal && tcgetattr(STDIN_FILENO, &saved) == 0) {
+        raw = saved;
+        raw.c_lflag &= ~(ICANON | ECHO | ISIG);
+        raw.c_cc[VMIN] = 1;
+        raw.c_cc[VTIME] = 0;
+        tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+    } else {
+        terminal = 0;
+    }
+
+    int length = 0;
+    int escape = 0;           // 1 after ESC, 2 inside a CSI sequence
+    int done = 0, ended = 0;
+    while (!done) {
+        if (pending_start == pending_end && !fill_pending()) {
+            ended = 1;
+            break;
+        }
+        unsigned char key = (unsigned char)pending[pending_start++];
+
+        if (key == '\n' || (key == '\r' && terminal)) {
+            done = 1;
+        } else if (!terminal) {
+            if (key != '\r' && length < size - 1) {
+                buffer[length++] = (char)key;
+            }
+        } else if (escape == 1) {
+            escape = key == '[' || key == 'O' ? 2 : 0;
+        } else if (escape == 2) {
+            escape = key >= 0x40 && key <= 0x7e ? 0 : 2;
+        } else if (key == KEY_ESCAPE) {
+            escape = 1;
+        } else if (key == KEY_BACKSPACE || key == KEY_DELETE) {
+            erase_chars(buffer, &length, 1);
+        } else if (key == KEY_KILL_LINE) {
+            erase_chars(buffer, &length, length);
+        } else if (key == KEY_EOF && length == 0) {
+            ended = 1;
+            break;
+        } else if (key == KEY_INTERRUPT) {
+            // As if the terminal had sent it
+            tcsetattr(STDIN_FILENO, TCSANOW, &saved);
+            fputs("^C\n", stdout);
+            fflush(stdout);
+            raise(SIGINT);
+        } else if (key >= 0x20 && length < size - 1) {
+            buffer[length++] = (char)key;
+            putchar(key);
+        }
+        if (terminal && pending_start == pending_end) {
+            fflush(stdout);
+        }
+    }
+
+    if (terminal) {
+        putchar('\n');
+        tcsetattr(STDIN_FILENO, TCSANOW, &saved);
+    }
+    buffer[length] = '\0';
+    if (ended && length == 0) {
+        if (!terminal) {
+            putchar('\n');
+        }
+        exit(0);
+    }
+}
+
+// Reads a line holding a whole number. Returns fallback if the line is
+// anything else.
+int read_int(int fallback) {
+    char line[32];
+    read_line(line, sizeof(line));
+    char* end;
+    errno = 0;
+    long value = strtol(line, &end, 10);
+    while (*end == ' ' || *end == '\t') {
+        end++;
+    }
+    if (end == line || *end != '\0' || errno != 0 || value < INT_MIN || value > INT_MAX) {
+        return fallback;
+    }
+    return (int)value;
+}
@@ -0,0 +1,15 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#define MAX_INPUT_TASKS 8
+
+// Console input. Lines are read in a poll() loop: on a terminal, keys
+// are edited in raw mode, and registered tasks run on their timers while
+// the loop waits. End of input exits the program (atexit handlers run).
+
+// Function prototypes
+void read_line(char* buffer, int size);
+int read_int(int fallback);
+int input_every(int interval_ms, void (*task)());
+
+#endif
@@ -0,0 +1,134 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "intmap.h"
+#include "lane.h"
+
+static void intmap_alloc(IntMap* map, size_t capacity) {
+    map->keys = malloc(capacity * sizeof(uint64_t));
+    map->values = malloc(capacity * sizeof(int64_t));
+    map->used = calloc(capacity, 1);
+    map->capacity = capacity;
+    map->count = 0;
+    if (map->keys == NULL || map->values == NULL || map->used == NULL) {
+        // Tables grow inside store updates, with the store lock held
+        out_of_memory_locked("allocating hash table");
+    }
+}
+
+// splitmix64 finalizer: cheap and mixes sequential ids well
+uint64_t intmap_hash(uint64_t key) {
+    key ^= key >> 30;
+    key *= 0xbf58476d1ce4e5b9ULL;
+    key ^= key >> 27;
+    key *= 0x94d049bb133111ebULL;
+    key ^= key >> 31;
+    return key;
+}
+
+void intmap_init(IntMap* map, size_t initial_capacity) {
+    size_t capacity = 16;
+    while (capacity < initial_capacity) {
+        capacity <<= 1;
+    }
+    intmap_alloc(map, capacity);
+}
+
+void intmap_free(IntMap* map) {
+    free(map->keys);
+    free(map->values);
+    free(map->used);
+    memset(map, 0, sizeof(*map));
+}
+
+void intmap_clear(IntMap* map) {
+    if (map->capacity > 0) {
+        memset(map->used, 0, map->capacity);
+    }
+    map->count = 0;
+}
+
+static size_t intmap_find_slot(const IntMap* map, uint64_t key) {
+    size_t mask = map->capacity - 1;
+    size_t i = intmap_hash(key) & mask;
+    while (map->used[i] && map->keys[i] != key) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+static void intmap_grow(IntMap* map) {
+    IntMap bigger;
+    intmap_alloc(&bigger, map->capacity ? map->capacity * 2 : 16);
+    for (size_t i = 0; i < map->capacity; i++) {
+        if (map->used[i]) {
+            size_t slot = intmap_find_slot(&bigger, map->keys[i]);
+            bigger.used[slot] = 1;
+            bigger.keys[slot] = map->keys[i];
+            bigger.values[slot] = map->values[i];
+            bigger.count++;
+        }
+    }
+    intmap_free(map);
+    *map = bigger;
+}
+
+int64_t* intmap_get(const IntMap* map, uint64_t key) {
+    if (map->capacity == 0) {
+        return NULL;
+    }
+    size_t slot = intmap_find_slot(map, key);
+    return map->used[slot] ? &map->values[slot] : NULL;
+}
+
+// Returns the value slot for key, inserting a zero value if it is new.
+// The pointer is only valid until the next insertion.
+int64_t* intmap_upsert(IntMap* map, uint64_t key, int* inserted) {
+    if ((map->count + 1) * 10 > map->capacity * 7) {
+        intmap_grow(map);
+    }
+    size_t slot = intmap_find_slot(map, key);
+    if (inserted) {
+        *inserted = !map->used[slot];
+    }
+    if (!map->used[slot]) {
+        map->used[slot] = 1;
+        map->keys[slot] = key;
+        map->values[slot] = 0;
+        map->count++;
+    }
+    return &map->values[slot];
+}
+
+void intmap_put(IntMap* map, uint64_t key, int64_t value) {
+    *intmap_upsert(map, key, NULL) = value;
+}
+
+int intmap_remove(IntMap* map, uint64_t key) {
+    if (map->capacity == 0) {
+        return 0;
+    }
+    size_t mask = map->capacity - 1;
+    size_t hole = intmap_find_slot(map, key);
+    if (!map->used[hole]) {
+        return 0;
+    }
+
+    // Backward-shift deletion keeps probe chains intact without tombstones
+    size_t i = hole;
+    while (1) {
+        i = (i + 1) & mask;
+        if (!map->used[i]) {
+            break;
+        }
+        size_t home = intmap_hash(map->keys[i]) & mask;
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            map->keys[hole] = map->keys[i];
+            map->values[hole] = map->values[i];
+            hole = i;
+        }
+    }
+    map->used[hole] = 0;
+    map->count--;
+    return 1;
+}
@@ -0,0 +1,28 @@
+#ifndef INTMAP_H
+#define INTMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Open-addressing hash table from 64-bit keys to 64-bit values.
+// Linear probing, power-of-two capacity, grows at 70% load. A zeroed
+// IntMap is a valid empty map; the first insertion allocates it.
+typedef struct {
+    uint64_t* keys;
+    int64_t* values;
+    unsigned char* used;
+    size_t capacity;
+    size_t count;
+} IntMap;
+
+// Function prototypes
+void intmap_init(IntMap* map, size_t initial_capacity);
+void intmap_free(IntMap* map);
+void intmap_clear(IntMap* map);
+int64_t* intmap_get(const IntMap* map, uint64_t key);
+int64_t* intmap_upsert(IntMap* map, uint64_t key, int* inserted);
+void intmap_put(IntMap* map, uint64_t key, int64_t value);
+int intmap_remove(IntMap* map, uint64_t key);
+uint64_t intmap_hash(uint64_t key);
+
+#endif
@@ -2,84 +2,157 @@
 #include <stdlib.h>
 #include <string.h>
 #include "item.h"
+#include "data_version.h"
+#include "promotions.h"
+#include "journal.h"
+#include "pager.h"
 
 // Global variables
 Item items[MAX_ITEMS];
 int item_count = 0;
-Cart cart = {.count = 0};
+money_t item_price_column[MAX_ITEMS];
+int item_stock_column[MAX_ITEMS];
+
+// Refreshes the packed columns and starts with nothing reserved
+static void sync_item_columns(int start, int end) {
+    for (int i = start; i < end; i++) {
+        item_price_column[i] = items[i].price;
+        item_stock_column[i] = items[i].stock;
+        items[i].available = items[i].stock;
+    }
+}
 
 void load_items() {
     FILE *file = fopen("data/items.dat", "r");
     if (file == NULL) {
         printf("Creating sample items data...\n");
         
-        // Create sample items
+        // Create sample items (prices in minor units)
         Item sample_items[] = {
-            {101, "Pen", 10.0, 100},
-            {102, "Notebook", 50.0, 200},
-            {103, "Pencil", 5.0, 150},
-            {104, "Eraser", 3.0, 80},
-            {105, "Ruler", 15.0, 60},
-            {106, "Calculator", 250.0, 25},
-            {107, "Stapler", 120.0, 40},
-            {108, "Paper Pack", 80.0, 75},
-            {109, "Marker", 25.0, 90},
-            {110, "Folder", 20.0, 120}
+            {101, "Pen", 1000, 100, 0},
+            {102, "Notebook", 5000, 200, 0},
+            {103, "Pencil", 500, 150, 0},
+            {104, "Eraser", 300, 80, 0},
+            {105, "Ruler", 1500, 60, 0},
+            {106, "Calculator", 25000, 25, 0},
+            {107, "Stapler", 12000, 40, 0},
+            {108, "Paper Pack", 8000, 75, 0},
+            {109, "Marker", 2500, 90, 0},
+            {110, "Folder", 2000, 120, 0}
         };
         
         item_count = sizeof(sample_items) / sizeof(Item);
         memcpy(items, sample_items, sizeof(sample_items));
+        sync_item_columns(0, item_count);
         save_items();
         return;
     }
     
     item_count = 0;
-    while (fscanf(file, "%d,%49[^,],%f,%d\n", 
+    char price[MONEY_STR_LEN];
+    while (fscanf(file, "%d,%49[^,],%23[^,],%d\n", 
                   &items[item_count].id, 
                   items[item_count].name, 
-                  &items[item_count].price, 
+                  price, 
                   &items[item_count].stock) == 4) {
+        if (!money_parse(price, &items[item_count].price)) break;
         item_count++;
         if (item_count >= MAX_ITEMS) break;
     }
     
     fclose(file);
+    sync_item_columns(0, item_count);
     printf("Loaded %d items from database.\n", item_count);
 }
 
-void save_items() {
-    FILE *file = fopen("data/items.dat", "w");
+// Copies the fields items.dat holds into list, so a checkpoint can write
+// them after releasing the store lock. Called with the store lock held;
+// available stock changes outside it and is not copied. Returns the
+// number of items.
+int snapshot_items(Item* list) {
+    for (int i = 0; i < item_count; i++) {
+        list[i].id = items[i].id;
+        strcpy(list[i].name, items[i].name);
+        list[i].price = items[i].price;
+        list[i].stock = items[i].stock;
+        list[i].available = 0;
+    }
+    return item_count;
+}
+
+int save_items() {
+    return save_item_list(items, item_count);
+}
+
+// Returns 1 once items.dat has been replaced with the given items
+int save_item_list(const Item* list, int count) {
+    FILE *file = fopen("data/items.dat.tmp", "w");
     if (file == NULL) {
         printf("Error: Cannot save items to file.\n");
-        return;
+        return 0;
     }
     
-    for (int i = 0; i < item_count; i++) {
-        fprintf(file, "%d,%s,%.2f,%d\n", 
-                items[i].id, 
-                items[i].name, 
-                items[i].price, 
-                items[i].stock);
+    char price[MONEY_STR_LEN];
+    for (int i = 0; i < count; i++) {
+        fprintf(file, "%d,%s,%s,%d\n", 
+                list[i].id, 
+                list[i].name, 
+                money_format(list[i].price, price), 
+                list[i].stock);
     }
     
-    fclose(file);
+    return replace_file(file, "data/items.dat.tmp", "data/items.dat");
 }
 
-void display_all_items() {
-    printf("\n==================================================\n");
-    printf("                   ALL ITEMS\n");
-    printf("==================================================\n");
-    printf("%-5s %-20s %-10s %-8s\n", "ID", "Name", "Price", "Stock");
-    printf("--------------------------------------------------\n");
-    
-    for (int i = 0; i < item_count; i++) {
-        printf("%-5d %-20s $%-9.2f %-8d\n", 
-               items[i].id, 
-               items[i].name, 
-               items[i].price, 
-               items[i].stock);
+static int item_rows() {
+    return item_count;
+}
+
+static int item_row_id(int index) {
+    return items[index].id;
+}
+
+static void format_item_row(int index, char* out, size_t size) {
+    char price[MONEY_STR_LEN];
+    snprintf(out, size, "%-5d %-20s $%-9s %-8d",
+             items[index].id,
+             items[index].name,
+             money_format(items[index].price, price),
+             item_stock_column[index]);
+}
+
+static int compare_items(int column, int a, int b) {
+    switch (column) {
+        case 0: return (items[a].id > items[b].id) - (items[a].id < items[b].id);
+        case 1: return strcmp(items[a].name, items[b].name);
+        case 2: return (items[a].price > items[b].price) - (items[a].price < items[b].price);
+        default: return (item_stock_column[a] > item_stock_column[b]) -
+                        (item_stock_column[a] < item_stock_column[b]);
     }
-    printf("==================================================\n");
+}
+
+// Every sale changes stock, so only the Stock sort watches it; the other
+// columns change only with the catalog
+static unsigned long item_sort_changed_at(int column) {
+    unsigned long catalog_at = data_changed_at(DATA_ITEMS, 0);
+    unsigned long stock_at = column == 3 ? data_changed_at(DATA_ITEM_STOCK, 0) : 0;
+    return stock_at > catalog_at ? stock_at : catalog_at;
+}
+
+static PagerSource item_pages = {
+    .title = "ALL ITEMS",
+    .header = "ID    Name                 Price      Stock",
+    .columns = {"ID", "Name", "Price", "Stock"},
+    .column_count = 4,
+    .changed_at = item_sort_changed_at,
+    .count = item_rows,
+    .row_id = item_row_id,
+    .format_row = format_item_row,
+    .compare = compare_items
+};
+
+void display_all_items() {
+    page_view(&item_pages);
 }
 
 void search_items(const char* query) {
@@ -91,15 +164,16 @@ void search_items(const char* query) {
     
     int found = 0;
     char id_str[20];
+    char price[MONEY_STR_LEN];
     
     for (int i = 0; i < item_count; i++) {
         sprintf(id_str, "%d", items[i].id);
         if (strstr(items[i].name, query) != NULL || 
             strstr(id_str, query) != NULL) {
-            printf("%-5d %-20s $%-9.2f %-8d\n", 
+            printf("%-5d %-20s $%-9s %-8d\n", 
                    items[i].id, 
                    items[i].name, 
-                   items[i].price, 
+                   money_format(items[i].price, price), 
                    items[i].stock);
             found = 1;
         }
@@ -120,44 +194,112 @@ Item* find_item_by_id(int id) {
     return NULL;
 }
 
-int add_to_cart(int item_id, int quantity) {
+Item* cart_line_item(const CartItem* line) {
+    return &items[line->item_index];
+}
+
+static int cart_spilled(const Cart* cart) {
+    return cart->capacity > CART_INLINE_LINES;
+}
+
+// Index of the item's line, or -1
+static int find_line(const Cart* cart, int item_id) {
+    if (cart_spilled(cart)) {
+        int64_t* slot = intmap_get(&cart->slots, (uint64_t)item_id);
+        return slot ? (int)*slot : -1;
+    }
+    for (int i = 0; i < cart->count; i++) {
+        if (cart_line_item(&cart->items[i])->id == item_id) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Makes room for one more line: starts on the inline lines, then moves
+// to a heap array that doubles, indexing the lines by item id as it spills
+static void grow_cart(Cart* cart) {
+    if (cart->items == NULL) {
+        cart->items = cart->inline_lines;
+        cart->capacity = CART_INLINE_LINES;
+        return;
+    }
+    
+    int capacity = cart->capacity * 2;
+    CartItem* lines;
+    if (cart_spilled(cart)) {
+        lines = realloc(cart->items, capacity * sizeof(CartItem));
+    } else {
+        lines = malloc(capacity * sizeof(CartItem));
+        if (lines != NULL) {
+            memcpy(lines, cart->inline_lines, cart->count * sizeof(CartItem));
+            for (int i = 0; i < cart->count; i++) {
+                intmap_put(&cart->slots, (uint64_t)cart_line_item(&lines[i])->id, i);
+            }
+        }
+    }
+    if (lines == NULL) {
+        printf("Error: Out of memory growing cart.\n");
+        exit(1);
+    }
+    cart->items = lines;
+    cart->capacity = capacity;
+}
+
+int add_to_cart(Cart* cart, int item_id, int quantity) {
     Item* item = find_item_by_id(item_id);
     if (item == NULL) {
         printf("Item not found!\n");
         return 0;
     }
     
-    if (item->stock < quantity) {
-        printf("Insufficient stock! Available: %d\n", item->stock);
+    if (quantity <= 0) {
+        printf("Quantity must be positive!\n");
         return 0;
     }
     
-    // Check if item already in cart
-    for (int i = 0; i < cart.count; i++) {
-        if (cart.items[i].item.id == item_id) {
-            if (item->stock < (cart.items[i].quantity + quantity)) {
-                printf("Total quantity exceeds stock! Available: %d\n", item->stock);
-                return 0;
-            }
-            cart.items[i].quantity += quantity;
-            return 1;
-        }
-    }
-    
-    // Add new item to cart
-    if (cart.count >= MAX_CART_ITEMS) {
-        printf("Cart is full!\n");
+    // Units in this cart are already held, so only the extra is reserved
+    if (!reserve_stock(item, quantity)) {
+        printf("Insufficient stock! Available: %d\n", __atomic_load_n(&item->available, __ATOMIC_RELAXED));
         return 0;
     }
     
-    cart.items[cart.count].item = *item;
-    cart.items[cart.count].quantity = quantity;
-    cart.count++;
+    add_reserved_to_cart(cart, item, quantity);
     return 1;
 }
 
-void display_cart() {
-    if (cart.count == 0) {
+// Adds units already reserved for this cart, as when a parked cart is
+// resumed. Merges with the item's line if there is one.
+void add_reserved_to_cart(Cart* cart, Item* item, int quantity) {
+    int item_id = item->id;
+    int index = find_line(cart, item_id);
+    if (index >= 0) {
+        CartItem* line = &cart->items[index];
+        line->quantity += quantity;
+        cart->units += quantity;
+        cart->total += line->price * quantity;
+        promotions_cart_changed(&cart->promotions, item_id, line->quantity, line->price);
+        return;
+    }
+    
+    // Add new item to cart
+    if (cart->count == cart->capacity) {
+        grow_cart(cart);
+    }
+    cart->items[cart->count].item_index = (int)(item - items);
+    cart->items[cart->count].quantity = quantity;
+    cart->items[cart->count].price = item->price;
+    if (cart_spilled(cart)) {
+        intmap_put(&cart->slots, (uint64_t)item_id, cart->count);
+    }
+    cart->count++;
+    cart->units += quantity;
+    cart->total += item->price * quantity;
+    promotions_cart_changed(&cart->promotions, item_id, quantity, item->price);
+}
+
+void display_cart(const Cart* cart) {
+    if (cart->count == 0) {
         printf("\nCart is empty!\n");
         return;
     }
@@ -168,60 +310,148 @@ void display_cart() {
     printf("%-5s %-20s %-10s %-5s %-10s\n", "ID", "Name", "Price", "Qty", "Total");
     printf("--------------------------------------------------\n");
     
-    float total_amount = 0;
-    for (int i = 0; i < cart.count; i++) {
-        float line_total = cart.items[i].item.price * cart.items[i].quantity;
-        total_amount += line_total;
-        printf("%-5d %-20s $%-9.2f %-5d $%-9.2f\n", 
-               cart.items[i].item.id, 
-               cart.items[i].item.name, 
-               cart.items[i].item.price, 
-               cart.items[i].quantity, 
-               line_total);
+    money_t total_amount = get_cart_total(cart);
+    char price[MONEY_STR_LEN], total[MONEY_STR_LEN];
+    for (int i = 0; i < cart->count; i++) {
+        const CartItem* line = &cart->items[i];
+        money_t line_total = line->price * line->quantity;
+        printf("%-5d %-20s $%-9s %-5d $%-9s\n", 
+               cart_line_item(line)->id, 
+               cart_line_item(line)->name, 
+               money_format(line->price, price), 
+               line->quantity, 
+               money_format(line_total, total));
     }
     
     printf("--------------------------------------------------\n");
-    printf("%-40s $%.2f\n", "TOTAL AMOUNT", total_amount);
+    
+    const Promo* applied[MAX_PROMOS];
+    money_t discounts[MAX_PROMOS];
+    int applied_count = promotions_applied(&cart->promotions, applied, discounts, MAX_PROMOS);
+    if (applied_count > 0) {
+        printf("%-40s $%s\n", "Subtotal", money_format(total_amount, total));
+        for (int i = 0; i < applied_count; i++) {
+            printf("  %-37s -$%s\n", applied[i]->name, money_format(discounts[i], total));
+        }
+        total_amount -= promotions_discount(&cart->promotions);
+    }
+    printf("%-40s $%s\n", "TOTAL AMOUNT", money_format(total_amount, total));
     printf("==================================================\n");
 }
 
-int remove_from_cart(int item_id) {
-    for (int i = 0; i < cart.count; i++) {
-        if (cart.items[i].item.id == item_id) {
-            // Shift remaining items
-            for (int j = i; j < cart.count - 1; j++) {
-                cart.items[j] = cart.items[j + 1];
-            }
-            cart.count--;
-            return 1;
+int remove_from_cart(Cart* cart, int item_id) {
+    int index = find_line(cart, item_id);
+    if (index < 0) {
+        return 0;
+    }
+    
+    // Swap-remove: move the last line into the freed slot
+    int last = cart->count - 1;
+    release_stock(cart_line_item(&cart->items[index]), cart->items[index].quantity);
+    cart->units -= cart->items[index].quantity;
+    cart->total -= cart->items[index].price * cart->items[index].quantity;
+    if (index != last) {
+        cart->items[index] = cart->items[last];
+        if (cart_spilled(cart)) {
+            intmap_put(&cart->slots, (uint64_t)cart_line_item(&cart->items[index])->id, index);
         }
     }
-    return 0;
+    if (cart_spilled(cart)) {
+        intmap_remove(&cart->slots, (uint64_t)item_id);
+    }
+    cart->count--;
+    promotions_cart_changed(&cart->promotions, item_id, 0, 0);
+    return 1;
+}
+
+money_t get_cart_total(const Cart* cart) {
+    return cart->total;
+}
+
+int get_cart_units(const Cart* cart) {
+    return cart->units;
+}
+
+static void empty_cart(Cart* cart) {
+    for (int i = 0; i < cart->count; i++) {
+        promotions_cart_changed(&cart->promotions, cart_line_item(&cart->items[i])->id, 0, 0);
+    }
+    cart->count = 0;
+    cart->units = 0;
+    cart->total = 0;
+    
+    // Back to the inline lines so the next basket does not allocate
+    if (cart_spilled(cart)) {
+        free(cart->items);
+        cart->items = cart->inline_lines;
+        cart->capacity = CART_INLINE_LINES;
+        intmap_clear(&cart->slots);
+    }
 }
 
-float get_cart_total() {
-    float total = 0;
-    for (int i = 0; i < cart.count; i++) {
-        total += cart.items[i].item.price * cart.items[i].quantity;
+// Abandons the cart and hands its reserved units back
+void clear_cart(Cart* cart) {
+    for (int i = 0; i < cart->count; i++) {
+        release_stock(cart_line_item(&cart->items[i]), cart->items[i].quantity);
     }
-    return total;
+    empty_cart(cart);
 }
 
-void clear_cart() {
-    cart.count = 0;
-    printf("Cart cleared!\n");
+// Empties a cart whose lines were just sold. Their reserved units were
+// consumed by commit_stock(), so nothing is released.
+void checkout_cart(Cart* cart) {
+    empty_cart(cart);
 }
 
-int is_cart_empty() {
-    return cart.count == 0;
+// Empties a cart whose reserved units have been handed to a parked
+// ticket; they stay reserved
+void detach_cart(Cart* cart) {
+    empty_cart(cart);
 }
 
-void update_item_stock(int item_id, int quantity_sold) {
-    for (int i = 0; i < item_count; i++) {
-        if (items[i].id == item_id) {
-            items[i].stock -= quantity_sold;
-            save_items();
-            break;
+int is_cart_empty(const Cart* cart) {
+    return cart->count == 0;
+}
+
+// Takes quantity units out of the item's available stock if there are
+// enough. Lock-free: tills selling different items never contend, and
+// two tills racing for the last units cannot both win.
+int reserve_stock(Item* item, int quantity) {
+    int available = __atomic_load_n(&item->available, __ATOMIC_RELAXED);
+    do {
+        if (available < quantity) {
+            return 0;
         }
-    }
-}
\ No newline at end of file
+    } while (!__atomic_compare_exchange_n(&item->available, &available, available - quantity,
+                                          1, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+    return 1;
+}
+
+void release_stock(Item* item, int quantity) {
+    __atomic_add_fetch(&item->available, quantity, __ATOMIC_RELEASE);
+}
+
+// Sets stock on hand outright, as when replaying the journal at startup
+// before any cart holds a reservation
+void set_item_stock(Item* item, int stock) {
+    item->stock = stock;
+    item->available = stock;
+    item_stock_column[item - items] = stock;
+}
+
+// A reserved quantity has been sold: it leaves stock on hand. Available
+// stock already excludes it.
+void commit_stock(Item* item, int quantity) {
+    int stock = __atomic_sub_fetch(&item->stock, quantity, __ATOMIC_RELAXED);
+    item_stock_column[item - items] = stock;
+    data_changed(DATA_ITEM_STOCK, item->id);
+}
+
+// Returned units go back on the shelf: both on hand and available to
+// carts straight away
+void restock_item(Item* item, int quantity) {
+    int stock = __atomic_add_fetch(&item->stock, quantity, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&item->available, quantity, __ATOMIC_RELEASE);
+    item_stock_column[item - items] = stock;
+    data_changed(DATA_ITEM_STOCK, item->id);
+}
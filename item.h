@@ -1,44 +1,79 @@
 #ifndef ITEM_H
 #define ITEM_H
 
+#include "money.h"
+#include "intmap.h"
+#include "promotions.h"
+
 #define MAX_NAME_LEN 50
 #define MAX_ITEMS 100
-#define MAX_CART_ITEMS 50
+#define CART_INLINE_LINES 16   // lines a cart holds before it allocates
 
 typedef struct {
     int id;
     char name[MAX_NAME_LEN];
-    float price;
-    int stock;
+    money_t price;
+    int stock;                // units on hand; lowered when a sale commits
+    int available;            // stock not reserved by any cart, updated atomically
 } Item;
 
+// A cart line refers to the catalog entry by index. The price is
+// locked in when the item is first added to the cart.
 typedef struct {
-    Item item;
+    int item_index;           // index into items[]
     int quantity;
+    money_t price;            // unit price snapshot
 } CartItem;
 
+// Dense line array with no size limit. A typical basket stays in
+// inline_lines and is searched linearly; a larger one moves to the heap
+// and is indexed by an item id -> line map until the cart is emptied.
+// Removal moves the last line into the hole, so line order is not
+// preserved. A zeroed Cart is empty. Carts must not be copied, since
+// items may point into the cart itself.
 typedef struct {
-    CartItem items[MAX_CART_ITEMS];
-    int count;
+    CartItem* items;          // inline_lines, or a heap array once spilled
+    CartItem inline_lines[CART_INLINE_LINES];
+    int count;                // lines
+    int capacity;
+    IntMap slots;             // item id -> line index, kept only once spilled
+    int units;                // sum of quantities, kept up to date
+    money_t total;            // sum of price x quantity, kept up to date
+    CartPromotions promotions;
 } Cart;
 
 // Function prototypes
 void load_items();
-void save_items();
+int save_items();
+int save_item_list(const Item* list, int count);
+int snapshot_items(Item* list);
 void display_all_items();
 void search_items(const char* query);
 Item* find_item_by_id(int id);
-int add_to_cart(int item_id, int quantity);
-void display_cart();
-int remove_from_cart(int item_id);
-float get_cart_total();
-void clear_cart();
-int is_cart_empty();
-void update_item_stock(int item_id, int quantity_sold);
+Item* cart_line_item(const CartItem* line);
+int add_to_cart(Cart* cart, int item_id, int quantity);
+void add_reserved_to_cart(Cart* cart, Item* item, int quantity);
+void display_cart(const Cart* cart);
+int remove_from_cart(Cart* cart, int item_id);
+money_t get_cart_total(const Cart* cart);
+void clear_cart(Cart* cart);
+void checkout_cart(Cart* cart);
+void detach_cart(Cart* cart);
+int is_cart_empty(const Cart* cart);
+int get_cart_units(const Cart* cart);
+int reserve_stock(Item* item, int quantity);
+void release_stock(Item* item, int quantity);
+void commit_stock(Item* item, int quantity);
+void restock_item(Item* item, int quantity);
+void set_item_stock(Item* item, int stock);
 
 // Global variables
 extern Item items[MAX_ITEMS];
 extern int item_count;
-extern Cart cart;
+
+// Packed copies of items[i].price and items[i].stock, same indexing,
+// for reports that scan the whole catalog
+extern money_t item_price_column[MAX_ITEMS];
+extern int item_stock_column[MAX_ITEMS];
 
 #endif
\ No newline at end of file
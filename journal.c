@@ -0,0 +1,455 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "journal.h"
+#include "lane.h"
+
+// One checkout or refund: a BEGIN header, one LINE per receipt line and
+// a COMMIT trailer carrying a checksum of the lines before it. A record
+// without a matching COMMIT was torn by a crash and is ignored on replay.
+#define JOURNAL_LINE_LEN 256
+#define JOURNAL_BUFFER_SIZE (1 << 16)
+
+// Group commit. Records are formatted into the filling buffer under the
+// store lock. Each lane then waits in journal_sync(), outside the lock,
+// for its record to reach the disk. The first lane to wait writes and
+// fsyncs everything buffered so far while the others keep appending to
+// the second buffer, so lanes checking out together share one fsync.
+typedef struct {
+    char* text;
+    size_t used;
+    size_t capacity;
+} GroupBuffer;
+
+static int journal_fd = -1;   // opened for appending on first use
+static pthread_mutex_t group_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t group_synced = PTHREAD_COND_INITIALIZER;
+static GroupBuffer buffers[2];
+static GroupBuffer* filling = &buffers[0];
+static unsigned long appended = 0;      // records formatted so far
+static unsigned long synced = 0;        // records known to be on disk
+static int flushing = 0;                // a lane is writing the other buffer
+static int failed = 0;                  // a write or fsync failed
+static int pending = 0;                 // records since the last checkpoint
+static off_t file_bytes = 0;            // length of the journal file
+static int batching = 0;                // a batch is open, on batch_thread
+static pthread_t batch_thread;
+
+// 32-bit FNV-1a, continued from hash
+static uint32_t checksum(const char* text, size_t length, uint32_t hash) {
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)text[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+#define CHECKSUM_SEED 2166136261u
+
+static void put_text(GroupBuffer* out, const char* text, size_t length) {
+    if (out->used + length > out->capacity) {
+        size_t capacity = out->capacity ? out->capacity : JOURNAL_BUFFER_SIZE;
+        while (capacity < out->used + length) {
+            capacity *= 2;
+        }
+        char* bigger = realloc(out->text, capacity);
+        if (bigger == NULL) {
+            out_of_memory_locked("writing the transaction journal");
+        }
+        out->text = bigger;
+        out->capacity = capacity;
+    }
+    memcpy(out->text + out->used, text, length);
+    out->used += length;
+}
+
+// Formats the record a line at a time onto the end of out
+static void write_record(GroupBuffer* out, const JournalRecord* record) {
+    const Receipt* receipt = &record->receipt;
+    char amount[MONEY_STR_LEN], price[MONEY_STR_LEN], discount[MONEY_STR_LEN], tax[MONEY_STR_LEN];
+    char text[JOURNAL_LINE_LEN];
+    int length = snprintf(text, sizeof(text), "BEGIN,%s,%d,%s,%s,%lld,%s,%s,%d%s%s\n",
+                           receipt->receipt_id,
+                           receipt->customer_id,
+                           receipt->date,
+                           money_format(receipt->total_amount, amount),
+                           (long long)receipt->timestamp,
+                           money_format(receipt->discount_amount, discount),
+                           money_format(receipt->tax_amount, tax),
+                           record->line_count,
+                           receipt->refund_of[0] ? "," : "",
+                           receipt->refund_of);
+    uint32_t hash = checksum(text, length, CHECKSUM_SEED);
+    put_text(out, text, length);
+    for (int i = 0; i < record->line_count; i++) {
+        const ReceiptDetail* line = &record->lines[i];
+        length = snprintf(text, sizeof(text), "LINE,%d,%s,%d,%s,%s,%d,%s\n",
+                         line->item_id,
+                         line->item_name,
+                         line->quantity,
+                         money_format(line->price, price),
+                         money_format(line->total, amount),
+                         record->stock[i],
+                         money_format(line->discount, discount));
+        hash = checksum(text, length, hash);
+        put_text(out, text, length);
+    }
+    length = snprintf(text, sizeof(text), "COMMIT,%s,%08x\n", receipt->receipt_id, (unsigned int)hash);
+    put_text(out, text, length);
+}
+
+static int open_journal() {
+    if (journal_fd < 0) {
+        journal_fd = open(JOURNAL_FILE, O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (journal_fd >= 0) {
+            file_bytes = lseek(journal_fd, 0, SEEK_END);
+        }
+    }
+    return journal_fd >= 0;
+}
+
+// Queues the record for the disk and sets ticket for journal_sync().
+// Called with the store lock held. Returns the number of records since
+// the last checkpoint, or 0 if the journal cannot be written; the
+// checkout must then not happen.
+int journal_append(const JournalRecord* record, unsigned long* ticket) {
+    if (!open_journal()) {
+        printf("Error: Cannot open the transaction journal.\n");
+        return 0;
+    }
+
+    pthread_mutex_lock(&group_mutex);
+    if (failed) {
+        pthread_mutex_unlock(&group_mutex);
+        printf("Error: Cannot write to the transaction journal.\n");
+        return 0;
+    }
+    write_record(filling, record);
+    *ticket = ++appended;
+    pthread_mutex_unlock(&group_mutex);
+    return ++pending;
+}
+
+static int write_all(int fd, const char* text, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(fd, text, length);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return 0;
+        }
+        text += written;
+        length -= (size_t)written;
+    }
+    return 1;
+}
+
+// Waits until the record with this ticket is on disk, writing it and
+// everything queued with it if no other lane is already doing so. Must
+// not be called with the store lock held. In a batch it returns at once
+// and journal_end_batch() does the waiting; other threads still wait for
+// their own records. Returns 0 if the journal could not be written.
+int journal_sync(unsigned long ticket) {
+    pthread_mutex_lock(&group_mutex);
+    if (batching && pthread_equal(batch_thread, pthread_self())) {
+        pthread_mutex_unlock(&group_mutex);
+        return 1;
+    }
+    while (synced < ticket && !failed) {
+        if (flushing) {
+            pthread_cond_wait(&group_synced, &group_mutex);
+            continue;
+        }
+        GroupBuffer* writing = filling;
+        filling = writing == &buffers[0] ? &buffers[1] : &buffers[0];
+        unsigned long target = appended;
+        flushing = 1;
+        pthread_mutex_unlock(&group_mutex);
+
+        int ok = write_all(journal_fd, writing->text, writing->used) && fsync(journal_fd) == 0;
+        size_t written = writing->used;
+        writing->used = 0;
+
+        pthread_mutex_lock(&group_mutex);
+        flushing = 0;
+        if (ok) {
+            synced = target;
+            file_bytes += (off_t)written;
+        } else {
+            failed = 1;
+        }
+        pthread_cond_broadcast(&group_synced);
+    }
+    int ok = synced >= ticket;
+    pthread_mutex_unlock(&group_mutex);
+    if (!ok) {
+        printf("Error: Cannot write to the transaction journal.\n");
+    }
+    return ok;
+}
+
+// True once a journal write has failed. Sales applied in memory may then
+// be missing from the journal, so they must not be saved either.
+int journal_failed() {
+    pthread_mutex_lock(&group_mutex);
+    int result = failed;
+    pthread_mutex_unlock(&group_mutex);
+    return result;
+}
+
+static int parse_begin(const char* line, JournalRecord* record, int* line_count) {
+    Receipt* receipt = &record->receipt;
+    char amount[MONEY_STR_LEN], discount[MONEY_STR_LEN], tax[MONEY_STR_LEN];
+    long long timestamp;
+    memset(record, 0, sizeof(*record));
+    // A refund names the sale it reverses in a ninth field
+    if (sscanf(line, "BEGIN,%9[^,],%d,%14[^,],%23[^,],%lld,%23[^,],%23[^,],%d,%9[^,\n]",
+               receipt->receipt_id,
+               &receipt->customer_id,
+               receipt->date,
+               amount,
+               &timestamp,
+               discount,
+               tax,
+               line_count,
+               receipt->refund_of) < 8 ||
+        !money_parse(amount, &receipt->total_amount) ||
+        !money_parse(discount, &receipt->discount_amount) ||
+        !money_parse(tax, &receipt->tax_amount) ||
+        *line_count < 1) {
+        return 0;
+    }
+    receipt->timestamp = timestamp;
+    return 1;
+}
+
+// Records from before line discounts were logged end at the stock field
+static int parse_line(const char* text, JournalRecord* record) {
+    ReceiptDetail* line = &record->lines[record->line_count];
+    char price[MONEY_STR_LEN], total[MONEY_STR_LEN], discount[MONEY_STR_LEN];
+    int fields = sscanf(text, "LINE,%d,%49[^,],%d,%23[^,],%23[^,],%d,%23[^,\n]",
+                        &line->item_id,
+                        line->item_name,
+                        &line->quantity,
+                        price,
+                        total,
+                        &record->stock[record->line_count],
+                        discount);
+    if (fields < 6 ||
+        !money_parse(price, &line->price) ||
+        !money_parse(total, &line->total)) {
+        return 0;
+    }
+    line->discount = DISCOUNT_UNKNOWN;
+    if (fields == 7 && !money_parse(discount, &line->discount)) {
+        return 0;
+    }
+    strcpy(line->receipt_id, record->receipt.receipt_id);
+    record->line_count++;
+    return 1;
+}
+
+// Calls apply for every complete record in the journal, oldest first.
+// Records must be applied idempotently: a crash during a checkpoint can
+// leave records that are already in the data files.
+int journal_replay(void (*apply)(const JournalRecord* record)) {
+    FILE* file = fopen(JOURNAL_FILE, "r");
+    if (file == NULL) {
+        return 0;
+    }
+
+    static JournalRecord record;
+    static int capacity = 0;
+    char line[JOURNAL_LINE_LEN];
+    int open = 0, expected = 0, applied = 0;
+    uint32_t hash = CHECKSUM_SEED;
+
+    while (fgets(line, sizeof(line), file) != NULL) {
+        if (strncmp(line, "BEGIN,", 6) == 0) {
+            ReceiptDetail* lines = record.lines;
+            int* stock = record.stock;
+            open = parse_begin(line, &record, &expected);
+            // A corrupt line count that cannot be allocated just makes
+            // the record unreadable
+            if (open && expected > capacity) {
+                ReceiptDetail* more_lines = realloc(lines, (size_t)expected * sizeof(ReceiptDetail));
+                lines = more_lines ? more_lines : lines;
+                int* more_stock = realloc(stock, (size_t)expected * sizeof(int));
+                stock = more_stock ? more_stock : stock;
+                if (more_lines != NULL && more_stock != NULL) {
+                    capacity = expected;
+                } else {
+                    open = 0;
+                }
+            }
+            record.lines = lines;
+            record.stock = stock;
+            hash = checksum(line, strlen(line), CHECKSUM_SEED);
+        } else if (open && strncmp(line, "LINE,", 5) == 0 && record.line_count < expected) {
+            open = parse_line(line, &record);
+            hash = checksum(line, strlen(line), hash);
+        } else if (open && strncmp(line, "COMMIT,", 7) == 0) {
+            char receipt_id[10];
+            unsigned int sum;
+            if (sscanf(line, "COMMIT,%9[^,],%x", receipt_id, &sum) == 2 &&
+                strcmp(receipt_id, record.receipt.receipt_id) == 0 &&
+                sum == hash && record.line_count == expected) {
+                apply(&record);
+                applied++;
+            }
+            open = 0;
+        } else {
+            open = 0;
+        }
+    }
+    fclose(file);
+
+    if (applied > 0) {
+        printf("Replayed %d records from the transaction journal.\n", applied);
+    }
+    return applied;
+}
+
+// Between these calls the calling thread's records are only buffered,
+// and it is expected to checkpoint once at the end instead of every 64
+// records. Only one thread may hold a batch open at a time.
+void journal_begin_batch() {
+    pthread_mutex_lock(&group_mutex);
+    batching = 1;
+    batch_thread = pthread_self();
+    pthread_mutex_unlock(&group_mutex);
+}
+
+int journal_batching() {
+    pthread_mutex_lock(&group_mutex);
+    int result = batching;
+    pthread_mutex_unlock(&group_mutex);
+    return result;
+}
+
+// Makes every record of the batch durable with one flush
+int journal_end_batch() {
+    pthread_mutex_lock(&group_mutex);
+    batching = 0;
+    unsigned long last = appended;
+    pthread_mutex_unlock(&group_mutex);
+    return journal_sync(last);
+}
+
+// True if the journal holds anything a checkpoint has not absorbed yet
+int journal_pending() {
+    FILE* file = fopen(JOURNAL_FILE, "r");
+    if (file == NULL) {
+        return 0;
+    }
+    int empty = fgetc(file) == EOF;
+    fclose(file);
+    return !empty;
+}
+
+// Empties the journal once its records are in the data files. Called
+// with the store lock held, so the checkpoint has also saved the records
+// still queued; they are dropped and their lanes released.
+void journal_reset() {
+    pthread_mutex_lock(&group_mutex);
+    while (flushing) {
+        pthread_cond_wait(&group_synced, &group_mutex);
+    }
+    filling->used = 0;
+    synced = appended;
+    if (!open_journal() || ftruncate(journal_fd, 0) != 0) {
+        printf("Error: Cannot empty the transaction journal.\n");
+    }
+    file_bytes = 0;
+    pending = 0;
+    pthread_cond_broadcast(&group_synced);
+    pthread_mutex_unlock(&group_mutex);
+}
+
+// Marks the point a checkpoint snapshot was taken, for journal_trim()
+// once the snapshot is saved. Called with the store lock held, so every
+// record before the mark is in the snapshot. Records still buffered land
+// after the mark and are kept; replaying them again is harmless.
+off_t journal_mark() {
+    pthread_mutex_lock(&group_mutex);
+    off_t mark = file_bytes;
+    pending = 0;
+    pthread_mutex_unlock(&group_mutex);
+    return mark;
+}
+
+// Copies the journal from offset to end into a new file open on fd
+static int copy_tail(int fd, off_t offset, off_t end) {
+    int in = open(JOURNAL_FILE, O_RDONLY);
+    if (in < 0) {
+        return 0;
+    }
+    char block[JOURNAL_BUFFER_SIZE];
+    int ok = 1;
+    while (ok && offset < end) {
+        size_t want = end - offset < (off_t)sizeof(block) ? (size_t)(end - offset) : sizeof(block);
+        ssize_t got = pread(in, block, want, offset);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        ok = got > 0 && write_all(fd, block, (size_t)got);
+        offset += got;
+    }
+    close(in);
+    return ok && fsync(fd) == 0;
+}
+
+// Drops the records before mark once a checkpoint has saved them. The
+// rest of the journal is copied to a new file that replaces it. Lanes go
+// on appending meanwhile; only flushes wait. Returns 0 if the journal
+// could not be rewritten, in which case it is left whole.
+int journal_trim(off_t mark) {
+    pthread_mutex_lock(&group_mutex);
+    while (flushing) {
+        pthread_cond_wait(&group_synced, &group_mutex);
+    }
+    flushing = 1;
+    off_t end = file_bytes;
+    pthread_mutex_unlock(&group_mutex);
+
+    int fd = open(JOURNAL_FILE ".tmp", O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    int ok = fd >= 0 && copy_tail(fd, mark, end) && rename(JOURNAL_FILE ".tmp", JOURNAL_FILE) == 0;
+    if (!ok) {
+        printf("Error: Cannot trim the transaction journal.\n");
+        if (fd >= 0) {
+            close(fd);
+        }
+        remove(JOURNAL_FILE ".tmp");
+    }
+
+    pthread_mutex_lock(&group_mutex);
+    if (ok) {
+        close(journal_fd);
+        journal_fd = fd;
+        file_bytes = end - mark;
+    }
+    flushing = 0;
+    pthread_cond_broadcast(&group_synced);
+    pthread_mutex_unlock(&group_mutex);
+    return ok;
+}
+
+// Finishes a file written to temp_path and renames it over path, so a
+// crash leaves either the old contents or the new, never a mix
+int replace_file(FILE* file, const char* temp_path, const char* path) {
+    int ok = fflush(file) == 0 && fsync(fileno(file)) == 0;
+    ok = fclose(file) == 0 && ok;
+    if (!ok || rename(temp_path, path) != 0) {
+        printf("Error: Cannot update %s.\n", path);
+        remove(temp_path);
+        return 0;
+    }
+    return 1;
+}
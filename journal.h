@@ -0,0 +1,35 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdio.h>
+#include <sys/types.h>
+#include "report.h"
+
+#define JOURNAL_FILE "data/journal.dat"
+#define JOURNAL_CHECKPOINT_RECORDS 64
+
+// Everything one checkout or refund changes: the receipt header, its
+// lines and each item's stock afterwards. Stock is logged as the new
+// value rather than a delta so replaying a record twice is harmless.
+typedef struct {
+    Receipt receipt;
+    ReceiptDetail* lines;
+    int* stock;               // by line
+    int line_count;
+} JournalRecord;
+
+// Function prototypes
+int journal_append(const JournalRecord* record, unsigned long* ticket);
+int journal_sync(unsigned long ticket);
+int journal_failed();
+int journal_replay(void (*apply)(const JournalRecord* record));
+int journal_pending();
+void journal_begin_batch();
+int journal_batching();
+int journal_end_batch();
+void journal_reset();
+off_t journal_mark();
+int journal_trim(off_t mark);
+int replace_file(FILE* file, const char* temp_path, const char* path);
+
+#endif
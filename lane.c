@@ -0,0 +1,125 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "lane.h"
+#include "report.h"
+#include "parallel.h"
+
+// Global variables
+Lane lanes[MAX_LANES];
+Lane* current_lane = &lanes[0];
+
+// Guards items[] stock, customers[], the receipt arrays and everything
+// updated when a receipt is committed
+static pthread_mutex_t store_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+typedef struct {
+    Lane* lane;
+    void (*serve)(Lane* lane, void* arg);
+    void* arg;
+} LaneTask;
+
+void init_lanes() {
+    for (int i = 0; i < MAX_LANES; i++) {
+        lanes[i].id = i + 1;
+        lanes[i].customer = NULL;
+        strcpy(lanes[i].current_screen, "Main Menu");
+        strcpy(lanes[i].last_message, "System Ready");
+        strcpy(lanes[i].last_receipt_id, "None");
+        lanes[i].last_transaction_amount = 0;
+    }
+}
+
+void lock_store() {
+    pthread_mutex_lock(&store_mutex);
+}
+
+void unlock_store() {
+    pthread_mutex_unlock(&store_mutex);
+}
+
+// Out of memory while the store lock, or the journal's, may be held.
+// exit() would run the save at exit, which takes the lock and would never
+// get it, so leave without it; every sale already confirmed is in the
+// journal.
+void out_of_memory_locked(const char* what) {
+    printf("Error: Out of memory %s.\n", what);
+    fflush(stdout);
+    _exit(1);
+}
+
+static void serve_lane(void* p) {
+    LaneTask* task = p;
+    task->serve(task->lane, task->arg);
+}
+
+// Runs serve on the first count lanes, each on its own thread, and waits
+// for all of them. Carts and pricing run in parallel; only the shared store
+// updates are serialized.
+void run_lanes(int count, void (*serve)(Lane* lane, void* arg), void* arg) {
+    LaneTask tasks[MAX_LANES];
+    if (count > MAX_LANES) count = MAX_LANES;
+    for (int i = 0; i < count; i++) {
+        tasks[i].lane = &lanes[i];
+        tasks[i].serve = serve;
+        tasks[i].arg = arg;
+    }
+    parallel_run(count, serve_lane, tasks, sizeof(LaneTask));
+}
+
+typedef struct {
+    int orders;
+    int completed[MAX_LANES];
+} Simulation;
+
+static uint32_t next_random(uint32_t* state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+// Each lane rings up random baskets for random customers and checks out
+static void simulate_lane(Lane* lane, void* arg) {
+    Simulation* simulation = arg;
+    uint32_t random = 2463534242u + (uint32_t)lane->id * 7919u;
+
+    for (int order = 0; order < simulation->orders; order++) {
+        lane->customer = &customers[next_random(&random) % customer_count];
+        int lines = 1 + next_random(&random) % 5;
+        for (int i = 0; i < lines; i++) {
+            const Item* item = &items[next_random(&random) % item_count];
+            add_to_cart(&lane->cart, item->id, 1 + next_random(&random) % 3);
+        }
+
+        Receipt receipt;
+        if (!is_cart_empty(&lane->cart) && generate_receipt(lane, &receipt, 0)) {
+            strcpy(lane->last_receipt_id, receipt.receipt_id);
+            lane->last_transaction_amount = receipt.total_amount;
+            simulation->completed[lane->id - 1]++;
+        }
+        clear_cart(&lane->cart);
+    }
+}
+
+// Load test: lane_count registers each checking out orders_per_lane
+// random baskets at once. Receipts and stock changes are real.
+// Returns the number of receipts written.
+int simulate_lanes(int lane_count, int orders_per_lane) {
+    Simulation simulation;
+    memset(&simulation, 0, sizeof(simulation));
+    simulation.orders = orders_per_lane;
+    if (customer_count == 0 || item_count == 0) {
+        return 0;
+    }
+
+    run_lanes(lane_count, simulate_lane, &simulation);
+
+    int total = 0;
+    for (int i = 0; i < MAX_LANES; i++) {
+        total += simulation.completed[i];
+    }
+    return total;
+}
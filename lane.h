@@ -0,0 +1,37 @@
+#ifndef LANE_H
+#define LANE_H
+
+#include "item.h"
+#include "customer.h"
+
+#define MAX_LANES 16
+#define LANE_SCREEN_LEN 50
+#define LANE_MESSAGE_LEN 100
+#define LANE_RECEIPT_ID_LEN 20
+
+// One checkout register: its own cart, selected customer and the state
+// shown in its status panel. Lanes share the catalog, customers and the
+// receipt store, which are guarded by the store lock.
+typedef struct {
+    int id;
+    Cart cart;
+    Customer* customer;
+    char current_screen[LANE_SCREEN_LEN];
+    char last_message[LANE_MESSAGE_LEN];
+    char last_receipt_id[LANE_RECEIPT_ID_LEN];
+    money_t last_transaction_amount;
+} Lane;
+
+// Function prototypes
+void init_lanes();
+void lock_store();
+void unlock_store();
+void out_of_memory_locked(const char* what);
+void run_lanes(int count, void (*serve)(Lane* lane, void* arg), void* arg);
+int simulate_lanes(int lane_count, int orders_per_lane);
+
+// Global variables
+extern Lane lanes[MAX_LANES];
+extern Lane* current_lane;    // the lane driven by the interactive console
+
+#endif
@@ -1,3 +1,5 @@
+#define _POSIX_C_SOURCE 200809L
+
 #define RESET       "\033[0m"
 #define RED         "\033[31m"
 #define GREEN       "\033[32m"
@@ -12,10 +14,22 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include "item.h"
 #include "customer.h"
 #include "report.h"
 #include "console_status.h"
+#include "promotions.h"
+#include "lane.h"
+#include "batch.h"
+#include "park.h"
+#include "journal.h"
+#include "input.h"
+#include "script.h"
+
+#define DEFAULT_TICK_MS 1000           // status panel clock
+#define EXPIRY_INTERVAL_MS 1000        // parked-cart timeouts
+#define AUTOSAVE_INTERVAL_MS 30000     // checkpoint the journal while idle
 
 void display_main_menu() {
     printf("\n%s══════════════════════════════════════════════════%s\n", CYAN, RESET);
@@ -53,7 +67,11 @@ void display_billing_menu() {
     printf("%s1.%s View Current Cart\n", YELLOW, RESET);
     printf("%s2.%s Generate Receipt\n", YELLOW, RESET);
     printf("%s3.%s Clear Cart\n", YELLOW, RESET);
-    printf("%s4.%s Back to Main Menu\n", YELLOW, RESET);
+    printf("%s4.%s Park Cart\n", YELLOW, RESET);
+    printf("%s5.%s Resume Parked Cart\n", YELLOW, RESET);
+    printf("%s6.%s List Parked Carts\n", YELLOW, RESET);
+    printf("%s7.%s Return Items\n", YELLOW, RESET);
+    printf("%s8.%s Back to Main Menu\n", YELLOW, RESET);
 }
 
 void display_reports_menu() {
@@ -61,7 +79,28 @@ void display_reports_menu() {
     printf("%s1.%s Daily Sales Report\n", YELLOW, RESET);
     printf("%s2.%s Customer Purchase History\n", YELLOW, RESET);
     printf("%s3.%s Item Sales Summary\n", YELLOW, RESET);
-    printf("%s4.%s Back to Main Menu\n", YELLOW, RESET);
+    printf("%s4.%s Items Bought Together\n", YELLOW, RESET);
+    printf("%s5.%s Distinct Customers\n", YELLOW, RESET);
+    printf("%s6.%s Basket Value Distribution\n", YELLOW, RESET);
+    printf("%s7.%s Hourly Sales Heatmap\n", YELLOW, RESET);
+    printf("%s8.%s Export Report to File\n", YELLOW, RESET);
+    printf("%s9.%s RFM Customer Segments (batch)\n", YELLOW, RESET);
+    printf("%s10.%s Inventory Valuation & Low Stock\n", YELLOW, RESET);
+    printf("%s11.%s Back to Main Menu\n", YELLOW, RESET);
+}
+
+void display_export_menu() {
+    printf("\n%s--- EXPORT REPORT --- %s\n", BOLD BLUE, RESET);
+    printf("%s1.%s Daily Sales\n", YELLOW, RESET);
+    printf("%s2.%s Customer Purchase History\n", YELLOW, RESET);
+    printf("%s3.%s Item Sales Summary\n", YELLOW, RESET);
+    printf("%s4.%s Items Bought Together\n", YELLOW, RESET);
+    printf("%s5.%s Distinct Customers\n", YELLOW, RESET);
+    printf("%s6.%s Basket Value Distribution\n", YELLOW, RESET);
+    printf("%s7.%s Hourly Sales Heatmap\n", YELLOW, RESET);
+    printf("%s8.%s Receipt History (all receipts)\n", YELLOW, RESET);
+    printf("%s9.%s Item History (all receipt lines)\n", YELLOW, RESET);
+    printf("%s10.%s Inventory Valuation\n", YELLOW, RESET);
 }
 
 void handle_item_management() {
@@ -72,14 +111,12 @@ void handle_item_management() {
     while (1) {
         display_item_menu();
         printf("\nEnter your choice: ");
-        scanf("%d", &choice);
-        getchar(); // consume newline
+        choice = read_int(0);
         
         switch (choice) {
             case 1:
                 printf("Enter item name or ID to search: ");
-                fgets(query, sizeof(query), stdin);
-                query[strcspn(query, "\n")] = 0; // Remove newline
+                read_line(query, sizeof(query));
                 search_items(query);
                 break;
                 
@@ -89,10 +126,10 @@ void handle_item_management() {
                 
             case 3:
                 printf("Enter item ID to add to cart: ");
-                scanf("%d", &item_id);
+                item_id = read_int(0);
                 printf("Enter quantity: ");
-                scanf("%d", &quantity);
-                if (add_to_cart(item_id, quantity)) {
+                quantity = read_int(0);
+                if (add_to_cart(&current_lane->cart, item_id, quantity)) {
                     printf("Item added to cart successfully!\n");
                     update_cart_status();
                     show_status_message("Item added to cart!");
@@ -103,13 +140,13 @@ void handle_item_management() {
                 break;
                 
             case 4:
-                display_cart();
+                display_cart(&current_lane->cart);
                 break;
                 
             case 5:
                 printf("Enter item ID to remove from cart: ");
-                scanf("%d", &item_id);
-                if (remove_from_cart(item_id)) {
+                item_id = read_int(0);
+                if (remove_from_cart(&current_lane->cart, item_id)) {
                     printf("Item removed from cart!\n");
                 } else {
                     printf("Item not found in cart!\n");
@@ -133,14 +170,12 @@ void handle_customer_management() {
     while (1) {
         display_customer_menu();
         printf("\nEnter your choice: ");
-        scanf("%d", &choice);
-        getchar(); // consume newline
+        choice = read_int(0);
         
         switch (choice) {
             case 1:
                 printf("Enter customer name, phone, or ID to search: ");
-                fgets(query, sizeof(query), stdin);
-                query[strcspn(query, "\n")] = 0;
+                read_line(query, sizeof(query));
                 search_customers(query);
                 break;
                 
@@ -154,11 +189,11 @@ void handle_customer_management() {
                 
             case 4:
                 printf("Enter customer ID: ");
-                scanf("%d", &customer_id);
-                current_customer = find_customer_by_id(customer_id);
-                if (current_customer) {
-                    printf("Selected customer: %s\n", current_customer->name);
-                    update_selected_customer(current_customer);
+                customer_id = read_int(0);
+                Customer* customer = find_customer_by_id(customer_id);
+                if (customer) {
+                    printf("Selected customer: %s\n", customer->name);
+                    update_selected_customer(customer);
                 } else {
                     printf("Customer not found!\n");
                     show_status_message("Customer not found!");
@@ -174,36 +209,92 @@ void handle_customer_management() {
     }
 }
 
+// Takes back items from an earlier sale and refunds them
+void handle_return() {
+    char receipt_id[10];
+    int item_id, quantity;
+    
+    printf("Enter receipt ID: ");
+    read_line(receipt_id, sizeof(receipt_id));
+    int line_count = show_returnable_lines(receipt_id);
+    if (line_count == 0) {
+        printf("No sale with receipt ID %s!\n", receipt_id);
+        return;
+    }
+    
+    // At most one entry per line on the receipt; repeats are added together
+    ReturnLine* returns = malloc(line_count * sizeof(ReturnLine));
+    if (returns == NULL) {
+        printf("Error: Out of memory.\n");
+        exit(1);
+    }
+    int count = 0;
+    while (1) {
+        printf("Enter item ID to return (0 to finish): ");
+        item_id = read_int(0);
+        if (item_id == 0) {
+            break;
+        }
+        printf("Enter quantity: ");
+        quantity = read_int(0);
+        int j = 0;
+        while (j < count && returns[j].item_id != item_id) {
+            j++;
+        }
+        if (j < count) {
+            returns[j].quantity += quantity;
+        } else if (count < line_count) {
+            returns[count].item_id = item_id;
+            returns[count].quantity = quantity;
+            count++;
+        } else {
+            printf("Item %d is not on receipt %s!\n", item_id, receipt_id);
+        }
+    }
+    
+    Receipt refund;
+    if (count == 0) {
+        printf("Nothing returned.\n");
+    } else if (refund_receipt(receipt_id, returns, count, &refund, 1)) {
+        printf("Refund recorded! Receipt ID: %s\n", refund.receipt_id);
+        update_last_transaction(refund.receipt_id, refund.total_amount);
+        show_status_message("Refund recorded");
+    } else {
+        printf("Return failed!\n");
+    }
+    free(returns);
+}
+
 void handle_billing() {
-    int choice;
+    int choice, ticket;
+    Lane* lane = current_lane;
     
     while (1) {
         display_billing_menu();
         printf("\nEnter your choice: ");
-        scanf("%d", &choice);
+        choice = read_int(0);
         
         switch (choice) {
             case 1:
-                display_cart();
+                display_cart(&lane->cart);
                 break;
                 
             case 2:
-                if (!current_customer) {
+                if (!lane->customer) {
                     printf("Please select a customer first!\n");
                     break;
                 }
                 
-                if (is_cart_empty()) {
+                if (is_cart_empty(&lane->cart)) {
                     printf("Cart is empty! Add items before generating receipt.\n");
                     break;
                 }
                 
-                char* receipt_id = generate_receipt(current_customer);
-                if (receipt_id) {
-                    printf("Receipt generated successfully! Receipt ID: %s\n", receipt_id);
-                    float total = get_cart_total();
-                    update_last_transaction(receipt_id, total);
-                    clear_cart();
+                Receipt receipt;
+                if (generate_receipt(lane, &receipt, 1)) {
+                    printf("Receipt generated successfully! Receipt ID: %s\n", receipt.receipt_id);
+                    update_last_transaction(receipt.receipt_id, receipt.total_amount);
+                    printf("Cart cleared!\n");
                     update_cart_status();
                 } else {
                     printf("Failed to generate receipt!\n");
@@ -211,10 +302,49 @@ void handle_billing() {
                 break;
                 
             case 3:
-                clear_cart();
+                clear_cart(&lane->cart);
+                printf("Cart cleared!\n");
                 break;
                 
             case 4:
+                ticket = park_cart(lane);
+                if (ticket == 0) {
+                    printf("Cart is empty! Nothing to park.\n");
+                    break;
+                }
+                printf("Cart parked as ticket %d. It will be held for %d minutes.\n",
+                       ticket, PARK_TIMEOUT_SECONDS / 60);
+                update_selected_customer(NULL);
+                update_cart_status();
+                show_status_message("Cart parked");
+                break;
+                
+            case 5:
+                if (!is_cart_empty(&lane->cart)) {
+                    printf("Park or clear the current cart first!\n");
+                    break;
+                }
+                printf("Enter ticket number: ");
+                ticket = read_int(0);
+                if (resume_cart(lane, ticket)) {
+                    printf("Ticket %d resumed.\n", ticket);
+                    update_selected_customer(lane->customer);
+                    update_cart_status();
+                    show_status_message("Parked cart resumed");
+                } else {
+                    printf("No parked cart with ticket %d (it may have expired).\n", ticket);
+                }
+                break;
+                
+            case 6:
+                list_parked_carts();
+                break;
+                
+            case 7:
+                handle_return();
+                break;
+                
+            case 8:
                 return;
                 
             default:
@@ -223,21 +353,92 @@ void handle_billing() {
     }
 }
 
+// Reads a YYYY-MM-DD date, defaulting to today on an empty line
+void read_date(const char* prompt, char* date, int size) {
+    printf("%s (YYYY-MM-DD) or press Enter for today: ", prompt);
+    read_line(date, size);
+    if (strlen(date) == 0) {
+        get_current_date(date);
+    }
+}
+
+int read_low_stock_threshold() {
+    printf("Low-stock threshold (units): ");
+    return read_int(20);
+}
+
+void handle_export() {
+    ReportParams params = {"", "", 0, 0, 0};
+    int report, format;
+    char path[100];
+    
+    display_export_menu();
+    printf("\nEnter report to export: ");
+    report = read_int(0);
+    if (report < REPORT_DAILY_SALES || report > REPORT_INVENTORY) {
+        printf("Invalid choice!\n");
+        return;
+    }
+    
+    switch (report) {
+        case REPORT_DAILY_SALES:
+            read_date("Enter date", params.from_date, sizeof(params.from_date));
+            break;
+        case REPORT_CUSTOMER_HISTORY:
+            if (!current_lane->customer) {
+                printf("Please select a customer first!\n");
+                return;
+            }
+            params.customer_id = current_lane->customer->id;
+            break;
+        case REPORT_DISTINCT_CUSTOMERS:
+        case REPORT_BASKET_VALUE:
+            read_date("Enter start date", params.from_date, sizeof(params.from_date));
+            read_date("Enter end date", params.to_date, sizeof(params.to_date));
+            if (report == REPORT_DISTINCT_CUSTOMERS) {
+                printf("Enter item ID (0 for all items): ");
+                params.item_id = read_int(0);
+            }
+            break;
+        case REPORT_INVENTORY:
+            params.threshold = read_low_stock_threshold();
+            break;
+    }
+    
+    printf("Format (1 = CSV, 2 = JSON Lines): ");
+    format = read_int(1);
+    const char* extension = format == 2 ? "jsonl" : "csv";
+    
+    printf("Output file or press Enter for data/report.%s: ", extension);
+    read_line(path, sizeof(path));
+    if (strlen(path) == 0) {
+        snprintf(path, sizeof(path), "data/report.%s", extension);
+    }
+    
+    int rows = export_report((ReportType)report, &params, format == 2 ? EXPORT_JSONL : EXPORT_CSV, path);
+    if (rows >= 0) {
+        printf("Exported %d rows to %s\n", rows, path);
+        show_status_message("Report exported");
+    } else {
+        show_status_message("Export failed!");
+    }
+}
+
 void handle_reports() {
     int choice;
     char date[20];
+    char to_date[20];
+    int item_id;
     
     while (1) {
         display_reports_menu();
         printf("\nEnter your choice: ");
-        scanf("%d", &choice);
-        getchar(); // consume newline
+        choice = read_int(0);
         
         switch (choice) {
             case 1:
                 printf("Enter date (YYYY-MM-DD) or press Enter for today: ");
-                fgets(date, sizeof(date), stdin);
-                date[strcspn(date, "\n")] = 0;
+                read_line(date, sizeof(date));
                 
                 if (strlen(date) == 0) {
                     get_current_date(date);
@@ -246,11 +447,11 @@ void handle_reports() {
                 break;
                 
             case 2:
-                if (!current_customer) {
+                if (!current_lane->customer) {
                     printf("Please select a customer first!\n");
                     break;
                 }
-                customer_purchase_history(current_customer->id);
+                customer_purchase_history(current_lane->customer->id);
                 break;
                 
             case 3:
@@ -258,6 +459,40 @@ void handle_reports() {
                 break;
                 
             case 4:
+                market_basket_report();
+                break;
+                
+            case 5:
+                read_date("Enter start date", date, sizeof(date));
+                read_date("Enter end date", to_date, sizeof(to_date));
+                printf("Enter item ID (0 for all items): ");
+                item_id = read_int(0);
+                distinct_customers_report(date, to_date, item_id);
+                break;
+                
+            case 6:
+                read_date("Enter start date", date, sizeof(date));
+                read_date("Enter end date", to_date, sizeof(to_date));
+                basket_value_report(date, to_date);
+                break;
+                
+            case 7:
+                hourly_heatmap_report();
+                break;
+                
+            case 8:
+                handle_export();
+                break;
+                
+            case 9:
+                rfm_segmentation_report("data/rfm_segments.txt");
+                break;
+                
+            case 10:
+                inventory_report(read_low_stock_threshold());
+                break;
+                
+            case 11:
                 return;
                 
             default:
@@ -266,15 +501,120 @@ void handle_reports() {
     }
 }
 
-int main() {
+// Background work run by the input loop between keystrokes
+
+static void expire_parked() {
+    int expired = expire_parked_carts();
+    if (expired > 0) {
+        char message[64];
+        snprintf(message, sizeof(message), "%d parked cart(s) expired", expired);
+        show_status_message(message);
+    }
+}
+
+// Folds the journal into the data files while the till is idle, so it
+// stays short and startup replays little
+static void autosave() {
+    if (journal_pending() > 0) {
+        lock_store();
+        checkpoint_store();
+        unlock_store();
+    }
+}
+
+static void save_on_exit() {
+    lock_store();
+    checkpoint_store();
+    unlock_store();
+}
+
+int main(int argc, char* argv[]) {
     int choice;
+    int tick_ms = DEFAULT_TICK_MS;
+    FILE* script_results = NULL;
+    
+    // Headless mode: --script [--batch] [FILE] runs commands from FILE or
+    // stdin. Results go to stdout and everything else printed goes to
+    // stderr. --batch flushes the journal once at the end instead of at
+    // every checkout.
+    const char* script_path = "-";
+    int script_batch = 0;
+    if (argc >= 2 && strcmp(argv[1], "--script") == 0) {
+        script_results = claim_stdout();
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "--batch") == 0) {
+                script_batch = 1;
+            } else {
+                script_path = argv[i];
+            }
+        }
+    }
     
     printf("Initializing XYZ Retail Store Billing System...\n");
     
     // Initialize data
     load_items();
+    load_promotions();
     load_customers();
     load_receipts();
+    load_pricing_rules();
+    init_lanes();
+    
+    if (script_results != NULL) {
+        return run_script(script_path, script_batch, script_results);
+    }
+    
+    // Load test: --lanes N [ORDERS] checks out ORDERS random baskets on
+    // each of N concurrent lanes against the real data files
+    if (argc >= 3 && strcmp(argv[1], "--lanes") == 0) {
+        int lane_count = atoi(argv[2]);
+        int orders = argc >= 4 ? atoi(argv[3]) : 100;
+        if (lane_count < 1 || lane_count > MAX_LANES || orders < 1) {
+            printf("Usage: %s --lanes <1-%d> [orders per lane]\n", argv[0], MAX_LANES);
+            return 1;
+        }
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        int completed = simulate_lanes(lane_count, orders);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        printf("%d lanes: %d receipts in %.3f s (%.0f receipts/s)\n",
+               lane_count, completed, seconds, seconds > 0 ? completed / seconds : 0.0);
+        checkpoint_store();
+        return 0;
+    }
+    
+    // Bulk load: --orders FILE checks out every order in a wholesale
+    // order file in one pass
+    if (argc >= 2 && strcmp(argv[1], "--orders") == 0) {
+        if (argc < 3) {
+            printf("Usage: %s --orders <order file>\n", argv[0]);
+            return 1;
+        }
+        int orders;
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        int completed = ingest_order_file(argv[2], &orders);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        if (completed < 0) {
+            printf("None of the %d orders were saved: the journal could not be written.\n", orders);
+            return 1;
+        }
+        printf("%d of %d orders checked out in %.3f s.\n", completed, orders, seconds);
+        return completed == orders ? 0 : 1;
+    }
+    
+    // --tick MS sets how often the status panel clock is redrawn (0 stops it)
+    if (argc >= 3 && strcmp(argv[1], "--tick") == 0) {
+        tick_ms = atoi(argv[2]);
+    }
+    
+    // Exit from the menu or at end of input saves everything
+    atexit(save_on_exit);
+    input_every(tick_ms, tick_status_panel);
+    input_every(EXPIRY_INTERVAL_MS, expire_parked);
+    input_every(AUTOSAVE_INTERVAL_MS, autosave);
     
     // Initialize console status display
     init_console_status();
@@ -286,7 +626,7 @@ int main() {
     while (1) {
         display_main_menu();
         printf("\nEnter your choice: ");
-        scanf("%d", &choice);
+        choice = read_int(0);
         
         switch (choice) {
             case 1:
@@ -0,0 +1,72 @@
+#include <stdio.h>
+#include <ctype.h>
+#include "money.h"
+
+// Parses "123", "123.4", "-0.05" etc. Digits past the second decimal are
+// rounded half away from zero. Returns 1 on success, 0 if not a number.
+int money_parse(const char* text, money_t* out) {
+    const char* p = text;
+    while (isspace((unsigned char)*p)) p++;
+
+    int negative = 0;
+    if (*p == '-' || *p == '+') {
+        negative = *p == '-';
+        p++;
+    }
+
+    money_t units = 0;
+    int digits = 0;
+    while (isdigit((unsigned char)*p)) {
+        units = units * 10 + (*p++ - '0');
+        digits++;
+    }
+
+    money_t fraction = 0;
+    int fraction_digits = 0;
+    int round_up = 0;
+    if (*p == '.') {
+        p++;
+        while (isdigit((unsigned char)*p)) {
+            if (fraction_digits < 2) {
+                fraction = fraction * 10 + (*p - '0');
+            } else if (fraction_digits == 2) {
+                round_up = *p >= '5';
+            }
+            fraction_digits++;
+            digits++;
+            p++;
+        }
+    }
+    if (digits == 0) {
+        return 0;
+    }
+    while (isspace((unsigned char)*p)) p++;
+    if (*p != '\0') {
+        return 0;
+    }
+
+    if (fraction_digits == 1) {
+        fraction *= 10;
+    }
+    money_t value = units * MONEY_SCALE + fraction + round_up;
+    *out = negative ? -value : value;
+    return 1;
+}
+
+// Formats as "-123.45" into buffer (MONEY_STR_LEN bytes) and returns it
+char* money_format(money_t value, char* buffer) {
+    unsigned long long magnitude = value < 0 ? 0ULL - (unsigned long long)value : (unsigned long long)value;
+    snprintf(buffer, MONEY_STR_LEN, "%s%llu.%02llu",
+             value < 0 ? "-" : "",
+             magnitude / MONEY_SCALE,
+             magnitude % MONEY_SCALE);
+    return buffer;
+}
+
+double money_to_double(money_t value) {
+    return (double)value / MONEY_SCALE;
+}
+
+money_t money_from_double(double value) {
+    return (money_t)(value * MONEY_SCALE + (value < 0 ? -0.5 : 0.5));
+}
@@ -0,0 +1,19 @@
+#ifndef MONEY_H
+#define MONEY_H
+
+#include <stdint.h>
+
+// Exact money amounts as integer minor units (paise / cents). All prices
+// and totals use this type; files keep the familiar "123.45" text form.
+typedef int64_t money_t;
+
+#define MONEY_SCALE 100
+#define MONEY_STR_LEN 24
+
+// Function prototypes
+int money_parse(const char* text, money_t* out);
+char* money_format(money_t value, char* buffer);
+double money_to_double(money_t value);
+money_t money_from_double(double value);
+
+#endif
@@ -0,0 +1,172 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pager.h"
+#include "input.h"
+
+// qsort() takes no context, so the column being sorted is passed here.
+// The pager only runs on the console thread.
+static PagerSource* sorting_source;
+static int sorting_column;
+
+static int compare_rows(const void* a, const void* b) {
+    int x = *(const int*)a;
+    int y = *(const int*)b;
+    int result = sorting_source->compare(sorting_column, x, y);
+    // Ties keep store order, so a sort is repeatable
+    return result != 0 ? result : (x > y) - (x < y);
+}
+
+// Returns the sort for column, rebuilding it first if what it sorts by
+// changed since it was built
+static PagerSort* ensure_sort(PagerSource* source, int column) {
+    PagerSort* sort = &source->sorts[column];
+    int count = source->count();
+    if (sort->version != 0 && sort->count == count &&
+        source->changed_at(column) <= sort->version) {
+        return sort;
+    }
+
+    if (count > sort->capacity) {
+        int capacity = count > 64 ? count : 64;
+        sort->order = realloc(sort->order, capacity * sizeof(int));
+        sort->rank = realloc(sort->rank, capacity * sizeof(int));
+        if (sort->order == NULL || sort->rank == NULL) {
+            printf("Error: Out of memory sorting %s.\n", source->title);
+            exit(1);
+        }
+        sort->capacity = capacity;
+    }
+    for (int i = 0; i < count; i++) {
+        sort->order[i] = i;
+    }
+    sorting_source = source;
+    sorting_column = column;
+    qsort(sort->order, count, sizeof(int), compare_rows);
+    for (int i = 0; i < count; i++) {
+        sort->rank[sort->order[i]] = i;
+    }
+    sort->count = count;
+    sort->version = data_version();
+    return sort;
+}
+
+// Store index of the row with this id, by binary search over the sort on
+// column 0, which is the id. Returns -1 if there is none.
+static int find_row(PagerSource* source, int id) {
+    PagerSort* by_id = ensure_sort(source, 0);
+    int low = 0, high = by_id->count - 1;
+    while (low <= high) {
+        int middle = low + (high - low) / 2;
+        int found = source->row_id(by_id->order[middle]);
+        if (found == id) {
+            return by_id->order[middle];
+        }
+        if (found < id) {
+            low = middle + 1;
+        } else {
+            high = middle - 1;
+        }
+    }
+    return -1;
+}
+
+// Shows the source a page at a time. Only the rows on the page are
+// formatted, so paging costs the same for any size of store. Commands:
+// Enter or n for the next page, p previous, f first, l last, a page
+// number, j <id> to jump to a row, s <column> to sort (again to reverse)
+// and q to go back.
+void page_view(PagerSource* source) {
+    int column = -1;          // -1 for store order
+    int descending = 0;
+    int top = 0;
+    int marked = -1;          // store index of the row jumped to
+    char command[32];
+    char row[160];
+
+    while (1) {
+        int count = source->count();
+        PagerSort* sort = column >= 0 ? ensure_sort(source, column) : NULL;
+        int pages = count > 0 ? (count + PAGER_ROWS - 1) / PAGER_ROWS : 1;
+        if (top >= count) {
+            top = (pages - 1) * PAGER_ROWS;
+        }
+        if (top < 0) {
+            top = 0;
+        }
+
+        printf("\n==================================================\n");
+        printf("                 %s\n", source->title);
+        printf("==================================================\n");
+        printf("%s\n", source->header);
+        printf("--------------------------------------------------\n");
+        int end = top + PAGER_ROWS < count ? top + PAGER_ROWS : count;
+        for (int position = top; position < end; position++) {
+            int index = position;
+            if (sort != NULL) {
+                index = sort->order[descending ? count - 1 - position : position];
+            }
+            source->format_row(index, row, sizeof(row));
+            printf("%s%s\n", row, index == marked ? " <" : "");
+        }
+        printf("--------------------------------------------------\n");
+        printf("Rows %d-%d of %d | Page %d/%d", count > 0 ? top + 1 : 0, end, count,
+               top / PAGER_ROWS + 1, pages);
+        if (column >= 0) {
+            printf(" | By %s%s", source->columns[column], descending ? " (desc)" : "");
+        }
+        printf("\nSort:");
+        for (int c = 0; c < source->column_count; c++) {
+            printf(" s%d %s", c + 1, source->columns[c]);
+        }
+        printf("\n[Enter] next, p prev, f first, l last, <page>, j <id>, q back: ");
+
+        read_line(command, sizeof(command));
+        char* text = command;
+        while (*text == ' ') {
+            text++;
+        }
+        int value;
+        marked = -1;
+        if (*text == '\0' || strcmp(text, "n") == 0) {
+            if (top + PAGER_ROWS < count) {
+                top += PAGER_ROWS;
+            }
+        } else if (strcmp(text, "p") == 0) {
+            top -= PAGER_ROWS;
+        } else if (strcmp(text, "f") == 0) {
+            top = 0;
+        } else if (strcmp(text, "l") == 0) {
+            top = (pages - 1) * PAGER_ROWS;
+        } else if (strcmp(text, "q") == 0) {
+            return;
+        } else if (sscanf(text, "j %d", &value) == 1 || sscanf(text, "j%d", &value) == 1) {
+            int index = find_row(source, value);
+            if (index < 0) {
+                printf("No row with ID %d.\n", value);
+                continue;
+            }
+            int position = index;
+            if (column >= 0) {
+                position = ensure_sort(source, column)->rank[index];
+                if (descending) {
+                    position = count - 1 - position;
+                }
+            }
+            top = position - position % PAGER_ROWS;
+            marked = index;
+        } else if (sscanf(text, "s %d", &value) == 1 || sscanf(text, "s%d", &value) == 1) {
+            if (value < 1 || value > source->column_count) {
+                printf("No column %d.\n", value);
+                continue;
+            }
+            descending = value - 1 == column ? !descending : 0;
+            column = value - 1;
+            top = 0;
+        } else if (sscanf(text, "%d", &value) == 1 && value >= 1 && value <= pages) {
+            top = (value - 1) * PAGER_ROWS;
+        } else {
+            printf("Invalid command!\n");
+        }
+    }
+}
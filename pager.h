@@ -0,0 +1,39 @@
+#ifndef PAGER_H
+#define PAGER_H
+
+#include <stddef.h>
+#include "data_version.h"
+
+#define PAGER_ROWS 15
+#define PAGER_MAX_COLUMNS 8
+
+// A sort order over the store: positions -> store indexes and back.
+// Built the first time a column is sorted on and rebuilt only when data
+// that column is ordered by has changed since.
+typedef struct {
+    int* order;               // position -> store index
+    int* rank;                // store index -> position
+    int capacity;
+    int count;
+    unsigned long version;    // data_version() when built; 0 if never
+} PagerSort;
+
+// A table the pager can page through. Rows are addressed by their index
+// in the store; the pager only ever formats the rows on screen.
+typedef struct {
+    const char* title;
+    const char* header;                         // column headings, pre-formatted
+    const char* columns[PAGER_MAX_COLUMNS];     // names for the sort prompt
+    int column_count;
+    unsigned long (*changed_at)(int column);    // data_changed_at() of what the column sorts by
+    int (*count)();
+    int (*row_id)(int index);
+    void (*format_row)(int index, char* out, size_t size);
+    int (*compare)(int column, int a, int b);   // by store index
+    PagerSort sorts[PAGER_MAX_COLUMNS];         // by column, built lazily
+} PagerSource;
+
+// Function prototypes
+void page_view(PagerSource* source);
+
+#endif
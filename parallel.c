@@ -0,0 +1,67 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+#include "parallel.h"
+
+typedef struct {
+    void (*fn)(void*);
+    void* arg;
+} WorkerStart;
+
+static void* worker_main(void* p) {
+    WorkerStart* start = p;
+    start->fn(start->arg);
+    return NULL;
+}
+
+int worker_count() {
+    // XYZ_THREADS overrides the detected core count
+    const char* env = getenv("XYZ_THREADS");
+    long n = env ? atol(env) : 0;
+#ifdef _WIN32
+    if (n <= 0 && getenv("NUMBER_OF_PROCESSORS")) {
+        n = atol(getenv("NUMBER_OF_PROCESSORS"));
+    }
+#else
+    if (n <= 0) {
+        n = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+#endif
+    if (n < 1) n = 1;
+    if (n > MAX_WORKERS) n = MAX_WORKERS;
+    return (int)n;
+}
+
+void parallel_run(int count, void (*fn)(void*), void* args, size_t arg_size) {
+    char* base = args;
+    if (count > MAX_WORKERS) count = MAX_WORKERS;
+    if (count <= 1) {
+        if (count == 1) fn(base);
+        return;
+    }
+
+    pthread_t threads[MAX_WORKERS];
+    WorkerStart starts[MAX_WORKERS];
+    int created[MAX_WORKERS] = {0};
+
+    // Element 0 runs on the calling thread; the rest get their own.
+    // If a thread cannot be created its work runs inline instead.
+    for (int i = 1; i < count; i++) {
+        starts[i].fn = fn;
+        starts[i].arg = base + i * arg_size;
+        created[i] = pthread_create(&threads[i], NULL, worker_main, &starts[i]) == 0;
+        if (!created[i]) {
+            fn(starts[i].arg);
+        }
+    }
+    fn(base);
+    for (int i = 1; i < count; i++) {
+        if (created[i]) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+}
@@ -0,0 +1,13 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stddef.h>
+
+#define MAX_WORKERS 16
+
+// Runs fn once per element of args (count elements of arg_size bytes each),
+// one thread per element. With a single element it runs on the caller.
+void parallel_run(int count, void (*fn)(void*), void* args, size_t arg_size);
+int worker_count();
+
+#endif
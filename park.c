@@ -0,0 +1,229 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "park.h"
+#include "item.h"
+#include "customer.h"
+#include "intmap.h"
+
+// A parked cart keeps its stock reserved and is stored as LEB128
+// varints: the line count, then item id and quantity for each line.
+// A typical basket takes a few dozen bytes. Parked carts live only in
+// memory, like the reservations they hold.
+#define VARINT_MAX_BYTES 5    // enough for any 32-bit value
+
+typedef struct {
+    int ticket;
+    int customer_id;          // 0 if no customer was selected
+    time_t parked_at;
+    int lines;
+    int units;
+    unsigned char* data;
+} ParkedCart;
+
+// Guarded by the store lock, since any lane may park or resume
+static ParkedCart* parked = NULL;
+static int parked_count = 0;
+static int parked_capacity = 0;
+static IntMap parked_by_ticket;       // ticket -> index into parked
+static int next_ticket = 1;
+
+static size_t put_varint(unsigned char* out, uint32_t value) {
+    size_t n = 0;
+    while (value >= 0x80) {
+        out[n++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = (unsigned char)value;
+    return n;
+}
+
+static const unsigned char* get_varint(const unsigned char* in, uint32_t* value) {
+    *value = 0;
+    for (int shift = 0; shift < 7 * VARINT_MAX_BYTES; shift += 7) {
+        unsigned char byte = *in++;
+        *value |= (uint32_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            break;
+        }
+    }
+    return in;
+}
+
+// Calls visit for every line of an encoded cart
+static void decode_cart(const ParkedCart* entry, void (*visit)(Item* item, int quantity, void* arg), void* arg) {
+    const unsigned char* in = entry->data;
+    uint32_t lines, item_id, quantity;
+    in = get_varint(in, &lines);
+    for (uint32_t i = 0; i < lines; i++) {
+        in = get_varint(in, &item_id);
+        in = get_varint(in, &quantity);
+        Item* item = find_item_by_id((int)item_id);
+        if (item != NULL) {
+            visit(item, (int)quantity, arg);
+        }
+    }
+}
+
+// Swap-remove, as for cart lines
+static void remove_parked(int index) {
+    intmap_remove(&parked_by_ticket, (uint64_t)parked[index].ticket);
+    int last = parked_count - 1;
+    if (index != last) {
+        parked[index] = parked[last];
+        intmap_put(&parked_by_ticket, (uint64_t)parked[index].ticket, index);
+    }
+    parked_count--;
+}
+
+// Parks the lane's cart under a new ticket and empties the lane for the
+// next customer. The reserved units stay reserved until the cart is
+// resumed or expires. Returns the ticket, or 0 if there was nothing to park.
+int park_cart(Lane* lane) {
+    Cart* cart = &lane->cart;
+    if (is_cart_empty(cart)) {
+        return 0;
+    }
+
+    unsigned char* data = malloc((size_t)(1 + 2 * cart->count) * VARINT_MAX_BYTES);
+    if (data == NULL) {
+        printf("Error: Out of memory parking cart.\n");
+        return 0;
+    }
+    size_t size = put_varint(data, (uint32_t)cart->count);
+    for (int i = 0; i < cart->count; i++) {
+        size += put_varint(data + size, (uint32_t)cart_line_item(&cart->items[i])->id);
+        size += put_varint(data + size, (uint32_t)cart->items[i].quantity);
+    }
+    unsigned char* shrunk = realloc(data, size);
+    if (shrunk != NULL) {
+        data = shrunk;
+    }
+
+    lock_store();
+    if (parked_count == parked_capacity) {
+        int capacity = parked_capacity > 0 ? parked_capacity * 2 : 16;
+        ParkedCart* bigger = realloc(parked, capacity * sizeof(ParkedCart));
+        if (bigger == NULL) {
+            unlock_store();
+            free(data);
+            printf("Error: Out of memory parking cart.\n");
+            return 0;
+        }
+        parked = bigger;
+        parked_capacity = capacity;
+    }
+    ParkedCart* entry = &parked[parked_count];
+    entry->ticket = next_ticket++;
+    entry->customer_id = lane->customer ? lane->customer->id : 0;
+    entry->parked_at = time(NULL);
+    entry->lines = cart->count;
+    entry->units = get_cart_units(cart);
+    entry->data = data;
+    intmap_put(&parked_by_ticket, (uint64_t)entry->ticket, parked_count);
+    parked_count++;
+    int ticket = entry->ticket;
+    unlock_store();
+
+    detach_cart(cart);
+    lane->customer = NULL;
+    return ticket;
+}
+
+static void restore_line(Item* item, int quantity, void* arg) {
+    add_reserved_to_cart(arg, item, quantity);
+}
+
+static void release_line(Item* item, int quantity, void* arg) {
+    (void)arg;
+    release_stock(item, quantity);
+}
+
+// Moves a parked cart onto the lane, which must have an empty cart, and
+// selects its customer again. The units are still reserved, so resuming
+// cannot fail for lack of stock. A ticket past PARK_TIMEOUT_SECONDS is
+// expired here even if expire_parked_carts() has not run yet. Returns 0
+// if the ticket is unknown or has expired.
+//
+// Only item ids and quantities are parked, so the restored lines are
+// priced at the item's current price, like a cart built from scratch.
+int resume_cart(Lane* lane, int ticket) {
+    lock_store();
+    int64_t* slot = intmap_get(&parked_by_ticket, (uint64_t)ticket);
+    if (slot == NULL) {
+        unlock_store();
+        return 0;
+    }
+    int index = (int)*slot;
+    ParkedCart entry = parked[index];
+    remove_parked(index);
+    if (time(NULL) - entry.parked_at >= PARK_TIMEOUT_SECONDS) {
+        decode_cart(&entry, release_line, NULL);
+        unlock_store();
+        free(entry.data);
+        return 0;
+    }
+    unlock_store();
+
+    decode_cart(&entry, restore_line, &lane->cart);
+    if (entry.customer_id != 0) {
+        lane->customer = find_customer_by_id(entry.customer_id);
+    }
+    free(entry.data);
+    return 1;
+}
+
+// Releases the stock of carts parked longer than PARK_TIMEOUT_SECONDS and
+// drops them. Returns the number expired.
+int expire_parked_carts() {
+    time_t now = time(NULL);
+    int expired = 0;
+
+    lock_store();
+    // Walking backwards, swap-remove only moves entries already checked
+    for (int i = parked_count - 1; i >= 0; i--) {
+        if (now - parked[i].parked_at >= PARK_TIMEOUT_SECONDS) {
+            decode_cart(&parked[i], release_line, NULL);
+            free(parked[i].data);
+            remove_parked(i);
+            expired++;
+        }
+    }
+    unlock_store();
+    return expired;
+}
+
+void list_parked_carts() {
+    time_t now = time(NULL);
+
+    lock_store();
+    if (parked_count == 0) {
+        unlock_store();
+        printf("\nNo parked carts.\n");
+        return;
+    }
+
+    printf("\n==================================================\n");
+    printf("                  PARKED CARTS\n");
+    printf("==================================================\n");
+    printf("%-7s %-20s %-6s %-6s %-10s\n", "Ticket", "Customer", "Lines", "Units", "Expires in");
+    printf("--------------------------------------------------\n");
+    for (int i = 0; i < parked_count; i++) {
+        const ParkedCart* entry = &parked[i];
+        const Customer* customer = entry->customer_id ? find_customer_by_id(entry->customer_id) : NULL;
+        long left = PARK_TIMEOUT_SECONDS - (long)(now - entry->parked_at);
+        if (left < 0) {
+            left = 0;
+        }
+        printf("%-7d %-20s %-6d %-6d %ldm %02lds\n",
+               entry->ticket,
+               customer ? customer->name : "-",
+               entry->lines,
+               entry->units,
+               left / 60, left % 60);
+    }
+    printf("==================================================\n");
+    unlock_store();
+}
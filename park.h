@@ -0,0 +1,14 @@
+#ifndef PARK_H
+#define PARK_H
+
+#include "lane.h"
+
+#define PARK_TIMEOUT_SECONDS (15 * 60)
+
+// Function prototypes
+int park_cart(Lane* lane);
+int resume_cart(Lane* lane, int ticket);
+void list_parked_carts();
+int expire_parked_carts();
+
+#endif
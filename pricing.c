@@ -0,0 +1,297 @@
+#include <stdio.h>
+#include <string.h>
+#include "pricing.h"
+#include "report.h"
+#include "intmap.h"
+#include "promotions.h"
+#include "lane.h"
+
+#define PRICING_RULES_FILE "data/pricing_rules.dat"
+
+typedef struct {
+    char name[MAX_RULE_NAME_LEN];
+    int rate;                     // basis points
+} RateRule;
+
+typedef struct {
+    char name[MAX_RULE_NAME_LEN];
+    money_t min_spend;
+    int rate;                     // basis points
+} TierRule;
+
+typedef struct {
+    int first_id;
+    int last_id;
+    int slab;
+} ItemRule;
+
+// Rules as read from the config file
+static RateRule slabs[MAX_TAX_SLABS];
+static int slab_count = 0;
+static TierRule tiers[MAX_TIERS + 1];     // tiers[0] is "no tier"
+static int tier_count = 1;
+static ItemRule item_rules[MAX_ITEMS];
+static int item_rule_count = 0;
+
+// Compiled lookup tables, indexed like items[] and customers[]
+static unsigned char item_slab[MAX_ITEMS];
+static int item_tax_rate[MAX_ITEMS];
+static unsigned char customer_tier[MAX_CUSTOMERS];
+static money_t customer_spend[MAX_CUSTOMERS];
+
+static const char* const sample_rules =
+    "# GST slabs: SLAB,<name>,<rate %>. Items not listed below use the first slab.\n"
+    "SLAB,exempt,0\n"
+    "SLAB,standard,12\n"
+    "SLAB,luxury,18\n"
+    "# Item categories: ITEM,<item id or first-last>,<slab name>\n"
+    "ITEM,101-105,standard\n"
+    "ITEM,106-110,luxury\n"
+    "# Customer tiers: TIER,<name>,<minimum lifetime spend>,<discount %>\n"
+    "TIER,Silver,200.00,2\n"
+    "TIER,Gold,1000.00,5\n";
+
+// "12" or "2.5" percent; two decimal places of a percent are basis points
+static int parse_rate(const char* text, int* rate) {
+    money_t value;
+    if (!money_parse(text, &value) || value < 0 || value > 100 * 100) {
+        return 0;
+    }
+    *rate = (int)value;
+    return 1;
+}
+
+static int find_slab(const char* name) {
+    for (int i = 0; i < slab_count; i++) {
+        if (strcmp(slabs[i].name, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int parse_rule(char* line) {
+    char kind[8], name[MAX_RULE_NAME_LEN], a[MONEY_STR_LEN], b[MONEY_STR_LEN];
+
+    if (sscanf(line, "%7[^,],", kind) != 1) {
+        return 0;
+    }
+
+    if (strcmp(kind, "SLAB") == 0) {
+        RateRule* slab = &slabs[slab_count];
+        if (slab_count >= MAX_TAX_SLABS ||
+            sscanf(line, "SLAB,%19[^,],%23[^,\n]", slab->name, a) != 2 ||
+            !parse_rate(a, &slab->rate)) {
+            return 0;
+        }
+        slab_count++;
+        return 1;
+    }
+
+    if (strcmp(kind, "ITEM") == 0) {
+        ItemRule* rule = &item_rules[item_rule_count];
+        if (item_rule_count >= MAX_ITEMS ||
+            sscanf(line, "ITEM,%23[^,],%19[^,\n]", a, name) != 2) {
+            return 0;
+        }
+        // A single id or a first-last range; anything else is no rule
+        int fields = sscanf(a, "%d-%d", &rule->first_id, &rule->last_id);
+        if (fields < 1) {
+            return 0;
+        }
+        if (fields == 1) {
+            rule->last_id = rule->first_id;
+        }
+        rule->slab = find_slab(name);
+        if (rule->slab < 0) {
+            return 0;
+        }
+        item_rule_count++;
+        return 1;
+    }
+
+    if (strcmp(kind, "TIER") == 0) {
+        TierRule* tier = &tiers[tier_count];
+        if (tier_count > MAX_TIERS ||
+            sscanf(line, "TIER,%19[^,],%23[^,],%23[^,\n]", tier->name, a, b) != 3 ||
+            !money_parse(a, &tier->min_spend) ||
+            !parse_rate(b, &tier->rate)) {
+            return 0;
+        }
+        // Keep tiers sorted by spend so the highest qualifying one wins
+        for (int i = tier_count; i > 1 && tiers[i - 1].min_spend > tiers[i].min_spend; i--) {
+            TierRule temp = tiers[i];
+            tiers[i] = tiers[i - 1];
+            tiers[i - 1] = temp;
+        }
+        tier_count++;
+        return 1;
+    }
+
+    return 0;
+}
+
+static void compile_item_rates() {
+    for (int i = 0; i < item_count; i++) {
+        int slab = 0;
+        // Later rules override earlier ones
+        for (int r = 0; r < item_rule_count; r++) {
+            if (items[i].id >= item_rules[r].first_id && items[i].id <= item_rules[r].last_id) {
+                slab = item_rules[r].slab;
+            }
+        }
+        item_slab[i] = (unsigned char)slab;
+        item_tax_rate[i] = slab_count > 0 ? slabs[slab].rate : 0;
+    }
+}
+
+static void compile_customer_tier(int slot) {
+    int tier = 0;
+    while (tier + 1 < tier_count && customer_spend[slot] >= tiers[tier + 1].min_spend) {
+        tier++;
+    }
+    customer_tier[slot] = (unsigned char)tier;
+}
+
+static void compile_customer_tiers() {
+    IntMap slot_of;
+    intmap_init(&slot_of, customer_count * 2);
+    for (int i = 0; i < customer_count; i++) {
+        intmap_put(&slot_of, (uint64_t)customers[i].id, i);
+        customer_spend[i] = 0;
+    }
+
+    for (int i = 0; i < receipt_count; i++) {
+        int64_t* slot = intmap_get(&slot_of, (uint64_t)receipts[i].customer_id);
+        if (slot) {
+            customer_spend[*slot] += receipts[i].total_amount;
+        }
+    }
+    intmap_free(&slot_of);
+
+    for (int i = 0; i < customer_count; i++) {
+        compile_customer_tier(i);
+    }
+}
+
+// Reads the rule file and compiles it into per-item tax rates and
+// per-customer tiers. Call after items, customers and receipts are loaded.
+void load_pricing_rules() {
+    FILE *file = fopen(PRICING_RULES_FILE, "r");
+    if (file == NULL) {
+        printf("Creating sample pricing rules...\n");
+        file = fopen(PRICING_RULES_FILE, "w");
+        if (file != NULL) {
+            fputs(sample_rules, file);
+            fclose(file);
+        }
+        file = fopen(PRICING_RULES_FILE, "r");
+    }
+
+    slab_count = 0;
+    tier_count = 1;
+    item_rule_count = 0;
+    strcpy(tiers[0].name, "None");
+    tiers[0].min_spend = 0;
+    tiers[0].rate = 0;
+
+    if (file != NULL) {
+        char line[128];
+        int line_number = 0;
+        while (fgets(line, sizeof(line), file) != NULL) {
+            line_number++;
+            if (line[0] == '#' || line[0] == '\n' || line[0] == '\r') {
+                continue;
+            }
+            if (!parse_rule(line)) {
+                printf("Warning: Ignoring invalid pricing rule on line %d.\n", line_number);
+            }
+        }
+        fclose(file);
+    }
+
+    compile_item_rates();
+    compile_customer_tiers();
+    printf("Loaded %d tax slabs and %d customer tiers.\n", slab_count, tier_count - 1);
+}
+
+static money_t apply_rate(money_t amount, int rate) {
+    return (amount * rate + RATE_SCALE / 2) / RATE_SCALE;
+}
+
+// GST on amount at the item's slab rate, as charged on one cart line
+money_t item_line_tax(const Item* item, money_t amount) {
+    return apply_rate(amount, item_tax_rate[item - items]);
+}
+
+void price_cart(const Cart* cart, const Customer* customer, PricingResult* result) {
+    price_cart_lines(cart, customer, result, NULL);
+}
+
+// Pure table lookups: one slab per line, one tier per customer, and the
+// promotion discount already kept up to date per item. If line_discounts
+// is not NULL it receives each line's promotion and tier discount, by
+// cart line, so a refund can later charge back that line's own GST.
+void price_cart_lines(const Cart* cart, const Customer* customer, PricingResult* result, money_t* line_discounts) {
+    memset(result, 0, sizeof(*result));
+    if (customer != NULL) {
+        // Other lanes re-tier customers as they check out
+        lock_store();
+        result->tier = customer_tier[customer - customers];
+        unlock_store();
+    }
+    int discount_rate = tiers[result->tier].rate;
+
+    for (int i = 0; i < cart->count; i++) {
+        const CartItem* line = &cart->items[i];
+        int slab = item_slab[line->item_index];
+        int tax_rate = item_tax_rate[line->item_index];
+
+        money_t amount = line->price * line->quantity;
+        money_t promotion = promotions_item_discount(&cart->promotions, cart_line_item(line)->id);
+        if (promotion > amount) {
+            promotion = amount;
+        }
+        money_t discount = apply_rate(amount - promotion, discount_rate);
+        money_t tax = apply_rate(amount - promotion - discount, tax_rate);
+
+        result->subtotal += amount;
+        result->promotions += promotion;
+        result->discount += discount;
+        result->tax += tax;
+        result->slab_tax[slab] += tax;
+        if (line_discounts != NULL) {
+            line_discounts[i] = promotion + discount;
+        }
+    }
+
+    result->total = result->subtotal - result->promotions - result->discount + result->tax;
+}
+
+// Adds a completed sale to the customer's lifetime spend and re-tiers
+// them; a refund passes a negative amount. Called with the store lock held.
+void pricing_record_sale(const Customer* customer, money_t amount) {
+    int slot = (int)(customer - customers);
+    customer_spend[slot] += amount;
+    compile_customer_tier(slot);
+}
+
+int tax_slab_count() {
+    return slab_count;
+}
+
+const char* tax_slab_name(int slab) {
+    return slabs[slab].name;
+}
+
+int tax_slab_rate(int slab) {
+    return slabs[slab].rate;
+}
+
+const char* tier_name(int tier) {
+    return tiers[tier].name;
+}
+
+int tier_rate(int tier) {
+    return tiers[tier].rate;
+}
@@ -0,0 +1,36 @@
+#ifndef PRICING_H
+#define PRICING_H
+
+#include "money.h"
+#include "item.h"
+#include "customer.h"
+
+#define MAX_TAX_SLABS 8
+#define MAX_TIERS 8
+#define MAX_RULE_NAME_LEN 20
+#define RATE_SCALE 10000          // rates are held in basis points
+
+// Tax and discount for one cart, produced by price_cart()
+typedef struct {
+    money_t subtotal;             // sum of price x quantity
+    money_t promotions;           // live promotion discounts
+    money_t discount;             // customer tier discount
+    money_t tax;                  // GST on the discounted amount
+    money_t total;                // subtotal - promotions - discount + tax
+    money_t slab_tax[MAX_TAX_SLABS];
+    int tier;                     // 0 when the customer has no tier
+} PricingResult;
+
+// Function prototypes
+void load_pricing_rules();
+void price_cart(const Cart* cart, const Customer* customer, PricingResult* result);
+void price_cart_lines(const Cart* cart, const Customer* customer, PricingResult* result, money_t* line_discounts);
+money_t item_line_tax(const Item* item, money_t amount);
+void pricing_record_sale(const Customer* customer, money_t amount);
+int tax_slab_count();
+const char* tax_slab_name(int slab);
+int tax_slab_rate(int slab);
+const char* tier_name(int tier);
+int tier_rate(int tier);
+
+#endif
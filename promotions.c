@@ -0,0 +1,291 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "promotions.h"
+#include "intmap.h"
+
+#define PROMOTIONS_FILE "data/promotions.dat"
+#define MAX_PROMO_LINKS (MAX_PROMOS * MAX_PROMO_ITEMS)
+
+static Promo promos[MAX_PROMOS];
+static int promo_count = 0;
+
+// item id -> first link; links chain every promo that mentions the item
+static IntMap promos_by_item;
+static int link_promo[MAX_PROMO_LINKS];
+static int link_next[MAX_PROMO_LINKS];
+static int link_count = 0;
+
+
+static const char* const sample_promotions =
+    "# BUYGET,<name>,<item id>,<buy qty>,<free qty>\n"
+    "BUYGET,Pens buy 2 get 1,101,2,1\n"
+    "# BUNDLE,<name>,<bundle price>,<item id>:<qty>;<item id>:<qty>...\n"
+    "BUNDLE,Office combo,330.00,106:1;107:1\n"
+    "# THRESHOLD,<name>,<minimum spend>,<amount off>,<item id>;<item id>...\n"
+    "THRESHOLD,Stationery 10 off 100,100.00,10.00,102;103;104;105;110\n";
+
+static int quantity_in_cart(const CartPromotions* state, int item_id) {
+    int64_t* quantity = intmap_get(&state->quantity, (uint64_t)item_id);
+    return quantity ? (int)*quantity : 0;
+}
+
+// Price locked in on the cart line; 0 if the item is not in the cart
+static money_t item_price(const CartPromotions* state, int item_id) {
+    int64_t* price = intmap_get(&state->price, (uint64_t)item_id);
+    return price ? *price : 0;
+}
+
+// Parses "101:2;102:1" (quantities default to 1)
+static int parse_item_list(char* list, Promo* promo) {
+    promo->item_count = 0;
+    for (char* token = strtok(list, ";\n\r"); token != NULL; token = strtok(NULL, ";\n\r")) {
+        int id, quantity = 1;
+        if (promo->item_count >= MAX_PROMO_ITEMS || sscanf(token, "%d:%d", &id, &quantity) < 1 ||
+            quantity <= 0) {
+            return 0;
+        }
+        promo->item_ids[promo->item_count] = id;
+        promo->quantities[promo->item_count] = quantity;
+        promo->item_count++;
+    }
+    return promo->item_count > 0;
+}
+
+static int parse_promo(char* line, Promo* promo) {
+    char kind[12], a[MONEY_STR_LEN], b[MONEY_STR_LEN], list[256];
+    int item_id;
+
+    memset(promo, 0, sizeof(*promo));
+    if (sscanf(line, "%11[^,],", kind) != 1) {
+        return 0;
+    }
+
+    if (strcmp(kind, "BUYGET") == 0) {
+        promo->type = PROMO_BUY_GET;
+        if (sscanf(line, "BUYGET,%39[^,],%d,%d,%d", promo->name, &item_id, &promo->buy, &promo->get) != 4 ||
+            promo->buy <= 0 || promo->get <= 0) {
+            return 0;
+        }
+        promo->item_ids[0] = item_id;
+        promo->quantities[0] = 1;
+        promo->item_count = 1;
+        return 1;
+    }
+
+    if (strcmp(kind, "BUNDLE") == 0) {
+        promo->type = PROMO_BUNDLE;
+        return sscanf(line, "BUNDLE,%39[^,],%23[^,],%255s", promo->name, a, list) == 3 &&
+               money_parse(a, &promo->price) &&
+               parse_item_list(list, promo);
+    }
+
+    if (strcmp(kind, "THRESHOLD") == 0) {
+        promo->type = PROMO_THRESHOLD;
+        return sscanf(line, "THRESHOLD,%39[^,],%23[^,],%23[^,],%255s", promo->name, a, b, list) == 4 &&
+               money_parse(a, &promo->price) &&
+               money_parse(b, &promo->amount_off) &&
+               parse_item_list(list, promo);
+    }
+
+    return 0;
+}
+
+static void index_promo(int index) {
+    const Promo* promo = &promos[index];
+    for (int i = 0; i < promo->item_count && link_count < MAX_PROMO_LINKS; i++) {
+        int inserted;
+        int64_t* head = intmap_upsert(&promos_by_item, (uint64_t)promo->item_ids[i], &inserted);
+        link_promo[link_count] = index;
+        link_next[link_count] = inserted ? -1 : (int)*head;
+        *head = link_count++;
+    }
+}
+
+void load_promotions() {
+    FILE *file = fopen(PROMOTIONS_FILE, "r");
+    if (file == NULL) {
+        printf("Creating sample promotions...\n");
+        file = fopen(PROMOTIONS_FILE, "w");
+        if (file != NULL) {
+            fputs(sample_promotions, file);
+            fclose(file);
+        }
+        file = fopen(PROMOTIONS_FILE, "r");
+    }
+
+    intmap_free(&promos_by_item);
+    intmap_init(&promos_by_item, 256);
+    promo_count = 0;
+    link_count = 0;
+
+    if (file != NULL) {
+        char line[512];
+        int line_number = 0;
+        while (fgets(line, sizeof(line), file) != NULL && promo_count < MAX_PROMOS) {
+            line_number++;
+            if (line[0] == '#' || line[0] == '\n' || line[0] == '\r') {
+                continue;
+            }
+            if (!parse_promo(line, &promos[promo_count])) {
+                printf("Warning: Ignoring invalid promotion on line %d.\n", line_number);
+                continue;
+            }
+            index_promo(promo_count);
+            promo_count++;
+        }
+        fclose(file);
+    }
+
+    printf("Loaded %d promotions.\n", promo_count);
+}
+
+static AppliedPromo* find_applied(CartPromotions* state, int index) {
+    for (int i = 0; i < state->applied_count; i++) {
+        if (state->applied[i].promo == index) {
+            return &state->applied[i];
+        }
+    }
+    return NULL;
+}
+
+static AppliedPromo* add_applied(CartPromotions* state, int index) {
+    if (state->applied_count == state->applied_capacity) {
+        int capacity = state->applied_capacity ? state->applied_capacity * 2 : 4;
+        AppliedPromo* bigger = realloc(state->applied, capacity * sizeof(AppliedPromo));
+        if (bigger == NULL) {
+            printf("Error: Out of memory applying promotions.\n");
+            exit(1);
+        }
+        state->applied = bigger;
+        state->applied_capacity = capacity;
+    }
+    AppliedPromo* entry = &state->applied[state->applied_count++];
+    memset(entry, 0, sizeof(*entry));
+    entry->promo = index;
+    return entry;
+}
+
+// Recomputes one promo from the current cart and folds the change in
+// its discount into the per-item and cart-wide running totals
+static void evaluate_promo(CartPromotions* state, int index) {
+    static const money_t no_shares[MAX_PROMO_ITEMS];
+    const Promo* promo = &promos[index];
+    AppliedPromo* entry = find_applied(state, index);
+    const money_t* old_shares = entry ? entry->shares : no_shares;
+    money_t shares[MAX_PROMO_ITEMS] = {0};
+    money_t values[MAX_PROMO_ITEMS] = {0};
+    money_t base = 0;
+    money_t discount = 0;
+
+    switch (promo->type) {
+        case PROMO_BUY_GET: {
+            int groups = quantity_in_cart(state, promo->item_ids[0]) / (promo->buy + promo->get);
+            discount = (money_t)groups * promo->get * item_price(state, promo->item_ids[0]);
+            values[0] = base = discount;
+            break;
+        }
+        case PROMO_BUNDLE: {
+            int sets = -1;
+            for (int i = 0; i < promo->item_count; i++) {
+                int possible = quantity_in_cart(state, promo->item_ids[i]) / promo->quantities[i];
+                if (sets < 0 || possible < sets) {
+                    sets = possible;
+                }
+            }
+            for (int i = 0; i < promo->item_count && sets > 0; i++) {
+                values[i] = (money_t)sets * promo->quantities[i] * item_price(state, promo->item_ids[i]);
+                base += values[i];
+            }
+            if (sets > 0 && base > sets * promo->price) {
+                discount = base - sets * promo->price;
+            }
+            break;
+        }
+        case PROMO_THRESHOLD:
+            for (int i = 0; i < promo->item_count; i++) {
+                values[i] = quantity_in_cart(state, promo->item_ids[i]) * item_price(state, promo->item_ids[i]);
+                base += values[i];
+            }
+            if (base > 0 && base >= promo->price) {
+                discount = promo->amount_off < base ? promo->amount_off : base;
+            }
+            break;
+    }
+
+    // Split the discount across the items in proportion to their value,
+    // putting the rounding remainder on the last item that has any
+    money_t remaining = discount;
+    int last = -1;
+    for (int i = 0; i < promo->item_count; i++) {
+        shares[i] = base > 0 ? discount * values[i] / base : 0;
+        if (values[i] > 0) {
+            last = i;
+        }
+        remaining -= shares[i];
+    }
+    if (last >= 0) {
+        shares[last] += remaining;
+    }
+    for (int i = 0; i < promo->item_count; i++) {
+        if (shares[i] != old_shares[i]) {
+            *intmap_upsert(&state->item_discount, (uint64_t)promo->item_ids[i], NULL) += shares[i] - old_shares[i];
+        }
+    }
+
+    state->discount_total += discount - (entry ? entry->discount : 0);
+
+    // Only promos that give a discount keep state; one that stops giving
+    // any has all-zero shares, so dropping it loses nothing
+    if (discount > 0) {
+        if (entry == NULL) {
+            entry = add_applied(state, index);
+        }
+        entry->discount = discount;
+        memcpy(entry->shares, shares, sizeof(shares));
+    } else if (entry != NULL) {
+        *entry = state->applied[--state->applied_count];
+    }
+}
+
+// Called on every cart mutation with the item's new quantity (0 when
+// removed). Only the promos that mention the item are re-evaluated, and
+// only those items are tracked, so a change to any other item costs one
+// lookup in promos_by_item and touches nothing in the cart.
+void promotions_cart_changed(CartPromotions* state, int item_id, int quantity, money_t price) {
+    int64_t* head = intmap_get(&promos_by_item, (uint64_t)item_id);
+    if (head == NULL) {
+        return;
+    }
+
+    if (quantity > 0) {
+        intmap_put(&state->quantity, (uint64_t)item_id, quantity);
+        intmap_put(&state->price, (uint64_t)item_id, price);
+    } else {
+        intmap_remove(&state->quantity, (uint64_t)item_id);
+        intmap_remove(&state->price, (uint64_t)item_id);
+    }
+
+    for (int link = (int)*head; link >= 0; link = link_next[link]) {
+        evaluate_promo(state, link_promo[link]);
+    }
+}
+
+money_t promotions_discount(const CartPromotions* state) {
+    return state->discount_total;
+}
+
+money_t promotions_item_discount(const CartPromotions* state, int item_id) {
+    int64_t* discount = intmap_get(&state->item_discount, (uint64_t)item_id);
+    return discount ? *discount : 0;
+}
+
+// Fills list and discounts with the promos currently giving a discount
+int promotions_applied(const CartPromotions* state, const Promo** list, money_t* discounts, int max) {
+    int n = state->applied_count < max ? state->applied_count : max;
+    for (int i = 0; i < n; i++) {
+        list[i] = &promos[state->applied[i].promo];
+        discounts[i] = state->applied[i].discount;
+    }
+    return n;
+}
@@ -0,0 +1,58 @@
+#ifndef PROMOTIONS_H
+#define PROMOTIONS_H
+
+#include "money.h"
+#include "intmap.h"
+
+#define MAX_PROMOS 512
+#define MAX_PROMO_ITEMS 16
+#define MAX_PROMO_NAME_LEN 40
+
+typedef enum {
+    PROMO_BUY_GET = 1,        // buy X of an item, get Y more free
+    PROMO_BUNDLE,             // fixed price for a set of items
+    PROMO_THRESHOLD           // amount off once spend on a set of items reaches a minimum
+} PromoType;
+
+typedef struct {
+    PromoType type;
+    char name[MAX_PROMO_NAME_LEN];
+    int item_ids[MAX_PROMO_ITEMS];
+    int quantities[MAX_PROMO_ITEMS];  // bundle: units needed per set
+    int item_count;
+    int buy;                  // buy-get: paid units per group
+    int get;                  // buy-get: free units per group
+    money_t price;            // bundle price, or threshold minimum spend
+    money_t amount_off;       // threshold discount
+} Promo;
+
+// Running state of one promo that is giving a cart a discount
+typedef struct {
+    int promo;                        // index into the loaded promos
+    money_t discount;
+    money_t shares[MAX_PROMO_ITEMS];  // split across the promo's item_ids
+} AppliedPromo;
+
+// Promotion results for one cart. Promos themselves are shared and
+// read-only after loading; each cart keeps its own running state, and
+// only for the promos that currently discount it. A zeroed
+// CartPromotions is an empty cart. The applied list is allocated on the
+// first match and kept for the cart's later baskets.
+typedef struct {
+    IntMap quantity;                  // item id -> units in cart, promo items only
+    IntMap price;                     // item id -> locked unit price, promo items only
+    IntMap item_discount;             // item id -> promo discount on that line
+    money_t discount_total;
+    AppliedPromo* applied;            // promos with a non-zero discount
+    int applied_count;
+    int applied_capacity;
+} CartPromotions;
+
+// Function prototypes
+void load_promotions();
+void promotions_cart_changed(CartPromotions* state, int item_id, int quantity, money_t price);
+money_t promotions_discount(const CartPromotions* state);
+money_t promotions_item_discount(const CartPromotions* state, int item_id);
+int promotions_applied(const CartPromotions* state, const Promo** list, money_t* discounts, int max);
+
+#endif
@@ -1,28 +1,175 @@
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include "report.h"
 #include "item.h"
+#include "intmap.h"
+#include "analytics.h"
+#include "report_cache.h"
+#include "data_version.h"
+#include "parallel.h"
+#include "promotions.h"
+#include "journal.h"
 
 // Global variables
-Receipt receipts[MAX_RECEIPTS];
-ReceiptDetail receipt_details[MAX_RECEIPT_DETAILS];
+Receipt* receipts = NULL;
+ReceiptDetail* receipt_details = NULL;
 int receipt_count = 0;
 int receipt_detail_count = 0;
+static int receipt_capacity = 0;
+static int receipt_detail_capacity = 0;
+
+// One past the highest receipt number on file; taken under the store lock
+static int next_receipt_number = 1;
+// Highest receipt number whose lines are in receipt_details.dat
+static int details_through = 0;
+// Rows of receipts and receipt_details that receipts.dat and
+// receipt_details.dat hold; a periodic checkpoint appends the rest
+static int receipts_on_disk = 0;
+static int details_on_disk = 0;
+
+// Receipt number -> index into receipts, and -> index of the receipt's
+// first row in receipt_details (a receipt's lines are stored together).
+// Kept up to date as receipts are added, so a return finds its sale
+// without scanning the history.
+static IntMap receipt_slots;
+static IntMap detail_slots;
+// Units of each detail row returned so far, parallel to receipt_details
+static int* returned_units = NULL;
+static int returned_capacity = 0;
+
+static int receipt_number(const char* receipt_id) {
+    int number;
+    return sscanf(receipt_id, "R%d", &number) == 1 ? number : 0;
+}
+
+static void restore_record(const JournalRecord* record);
+static void share_unknown_discounts();
+
+static void* grow_array(void* array, int* capacity, int needed, size_t size) {
+    if (needed <= *capacity) {
+        return array;
+    }
+    int bigger = *capacity > 0 ? *capacity : 256;
+    while (bigger < needed) {
+        bigger *= 2;
+    }
+    array = realloc(array, (size_t)bigger * size);
+    if (array == NULL) {
+        out_of_memory_locked("storing receipts");
+    }
+    *capacity = bigger;
+    return array;
+}
+
+// Makes room for more receipts and detail rows. Either array may move,
+// so no pointer into them is kept across a call. Called with the store
+// lock held once lanes are running.
+static void reserve_receipts(int more_receipts, int more_details) {
+    receipts = grow_array(receipts, &receipt_capacity,
+                          receipt_count + more_receipts, sizeof(Receipt));
+    receipt_details = grow_array(receipt_details, &receipt_detail_capacity,
+                                 receipt_detail_count + more_details, sizeof(ReceiptDetail));
+    if (returned_capacity < receipt_detail_capacity) {
+        returned_units = realloc(returned_units, receipt_detail_capacity * sizeof(int));
+        if (returned_units == NULL) {
+            out_of_memory_locked("storing receipts");
+        }
+        memset(returned_units + returned_capacity, 0,
+               (receipt_detail_capacity - returned_capacity) * sizeof(int));
+        returned_capacity = receipt_detail_capacity;
+    }
+}
+
+static void index_receipt(int index) {
+    intmap_put(&receipt_slots, (uint64_t)receipt_number(receipts[index].receipt_id), index);
+}
+
+// Indexes a detail row; only a receipt's first row is recorded
+static void index_detail(int index) {
+    int inserted;
+    int64_t* slot = intmap_upsert(&detail_slots, (uint64_t)receipt_number(receipt_details[index].receipt_id),
+                                  &inserted);
+    if (inserted) {
+        *slot = index;
+    }
+}
+
+// Finds a receipt's lines: returns how many there are and sets first to
+// the row of the first one
+static int receipt_lines(int number, int* first) {
+    int64_t* slot = intmap_get(&detail_slots, (uint64_t)number);
+    *first = 0;
+    if (slot == NULL) {
+        return 0;
+    }
+    *first = (int)*slot;
+    int end = *first + 1;
+    while (end < receipt_detail_count &&
+           strcmp(receipt_details[end].receipt_id, receipt_details[*first].receipt_id) == 0) {
+        end++;
+    }
+    return end - *first;
+}
+
+// Row of item_id among count lines starting at first, or -1
+static int find_receipt_line(int first, int count, int item_id) {
+    for (int i = first; i < first + count; i++) {
+        if (receipt_details[i].item_id == item_id) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Counts a refund's lines against the sale they reverse
+static void note_refund(const Receipt* refund, const ReceiptDetail* lines, int count) {
+    int first;
+    int sold = receipt_lines(receipt_number(refund->refund_of), &first);
+    for (int i = 0; i < count; i++) {
+        int row = find_receipt_line(first, sold, lines[i].item_id);
+        if (row >= 0) {
+            returned_units[row] -= lines[i].quantity;
+        }
+    }
+}
 
 void load_receipts() {
-    // Load receipt headers
+    // Load receipt headers. Rows written before timestamps were recorded
+    // have only four fields and rows from before the pricing engine have
+    // five; the missing timestamp, discount and tax stay 0. Refunds carry
+    // an eighth field naming the sale they reverse.
     FILE *file = fopen("data/receipts.dat", "r");
     if (file != NULL) {
+        char line[128];
         receipt_count = 0;
-        while (fscanf(file, "%9[^,],%d,%14[^,],%f\n", 
-                      receipts[receipt_count].receipt_id, 
-                      &receipts[receipt_count].customer_id, 
-                      receipts[receipt_count].date, 
-                      &receipts[receipt_count].total_amount) == 4) {
+        while (fgets(line, sizeof(line), file) != NULL) {
+            reserve_receipts(1, 0);
+            Receipt* receipt = &receipts[receipt_count];
+            char amount[MONEY_STR_LEN], discount[MONEY_STR_LEN] = "0", tax[MONEY_STR_LEN] = "0";
+            long long timestamp = 0;
+            receipt->refund_of[0] = '\0';
+            int fields = sscanf(line, "%9[^,],%d,%14[^,],%23[^,\n],%lld,%23[^,],%23[^,\n],%9[^,\n]",
+                                receipt->receipt_id,
+                                &receipt->customer_id,
+                                receipt->date,
+                                amount,
+                                &timestamp,
+                                discount,
+                                tax,
+                                receipt->refund_of);
+            if (fields < 4 || !money_parse(amount, &receipt->total_amount) ||
+                !money_parse(discount, &receipt->discount_amount) ||
+                !money_parse(tax, &receipt->tax_amount)) break;
+            receipt->timestamp = timestamp;
+            int number = receipt_number(receipt->receipt_id);
+            if (number >= next_receipt_number) {
+                next_receipt_number = number + 1;
+            }
+            index_receipt(receipt_count);
             receipt_count++;
-            if (receipt_count >= MAX_RECEIPTS) break;
         }
         fclose(file);
     }
@@ -30,100 +177,439 @@ void load_receipts() {
     // Load receipt details
     file = fopen("data/receipt_details.dat", "r");
     if (file != NULL) {
+        char line[256], price[MONEY_STR_LEN], total[MONEY_STR_LEN], discount[MONEY_STR_LEN];
         receipt_detail_count = 0;
-        while (fscanf(file, "%9[^,],%d,%49[^,],%d,%f,%f\n", 
-                      receipt_details[receipt_detail_count].receipt_id, 
-                      &receipt_details[receipt_detail_count].item_id, 
-                      receipt_details[receipt_detail_count].item_name, 
-                      &receipt_details[receipt_detail_count].quantity, 
-                      &receipt_details[receipt_detail_count].price, 
-                      &receipt_details[receipt_detail_count].total) == 6) {
+        while (fgets(line, sizeof(line), file) != NULL) {
+            reserve_receipts(0, 1);
+            ReceiptDetail* detail = &receipt_details[receipt_detail_count];
+            // The line discount was added later as a seventh field
+            int fields = sscanf(line, "%9[^,],%d,%49[^,],%d,%23[^,],%23[^,\n],%23[^,\n]", 
+                                detail->receipt_id, 
+                                &detail->item_id, 
+                                detail->item_name, 
+                                &detail->quantity, 
+                                price, 
+                                total,
+                                discount);
+            if (fields < 6 ||
+                !money_parse(price, &detail->price) ||
+                !money_parse(total, &detail->total)) break;
+            detail->discount = DISCOUNT_UNKNOWN;
+            if (fields == 7 && !money_parse(discount, &detail->discount)) break;
+            int number = receipt_number(detail->receipt_id);
+            if (number > details_through) {
+                details_through = number;
+            }
+            index_detail(receipt_detail_count);
             receipt_detail_count++;
-            if (receipt_detail_count >= MAX_RECEIPT_DETAILS) break;
         }
         fclose(file);
     }
+    
+    // Units already returned, from the refunds on file
+    for (int i = 0; i < receipt_count; i++) {
+        if (receipts[i].refund_of[0] != '\0') {
+            int first;
+            int count = receipt_lines(receipt_number(receipts[i].receipt_id), &first);
+            note_refund(&receipts[i], &receipt_details[first], count);
+        }
+    }
+    
+    receipts_on_disk = receipt_count;
+    details_on_disk = receipt_detail_count;
+    
+    // Checkouts logged since the last checkpoint; write them through so
+    // the journal starts empty
+    journal_replay(restore_record);
+    share_unknown_discounts();
+    analytics_rebuild();
+    if (journal_pending()) {
+        checkpoint_store();
+    }
+}
+
+static void write_receipt_row(FILE* file, const Receipt* receipt) {
+    char amount[MONEY_STR_LEN], discount[MONEY_STR_LEN], tax[MONEY_STR_LEN];
+    fprintf(file, "%s,%d,%s,%s,%lld,%s,%s%s%s\n", 
+            receipt->receipt_id, 
+            receipt->customer_id, 
+            receipt->date, 
+            money_format(receipt->total_amount, amount),
+            (long long)receipt->timestamp,
+            money_format(receipt->discount_amount, discount),
+            money_format(receipt->tax_amount, tax),
+            receipt->refund_of[0] ? "," : "",
+            receipt->refund_of);
+}
+
+static void write_detail_row(FILE* file, const ReceiptDetail* detail) {
+    char amount[MONEY_STR_LEN], price[MONEY_STR_LEN], discount[MONEY_STR_LEN];
+    fprintf(file, "%s,%d,%s,%d,%s,%s,%s\n", 
+            detail->receipt_id, 
+            detail->item_id, 
+            detail->item_name, 
+            detail->quantity, 
+            money_format(detail->price, price), 
+            money_format(detail->total, amount),
+            money_format(detail->discount, discount));
 }
 
-void save_receipts() {
+// Returns 1 once both receipt files have been replaced. The digests are
+// only a cache rebuilt from the receipts, so they do not count.
+int save_receipts() {
     // Save receipt headers
-    FILE *file = fopen("data/receipts.dat", "w");
-    if (file != NULL) {
+    int saved = 0;
+    FILE *file = fopen("data/receipts.dat.tmp", "w");
+    if (file == NULL) {
+        printf("Error: Cannot save receipts to file.\n");
+    } else {
         for (int i = 0; i < receipt_count; i++) {
-            fprintf(file, "%s,%d,%s,%.2f\n", 
-                    receipts[i].receipt_id, 
-                    receipts[i].customer_id, 
-                    receipts[i].date, 
-                    receipts[i].total_amount);
+            write_receipt_row(file, &receipts[i]);
+        }
+        saved = replace_file(file, "data/receipts.dat.tmp", "data/receipts.dat");
+        if (saved) {
+            receipts_on_disk = receipt_count;
         }
-        fclose(file);
     }
     
     // Save receipt details
-    file = fopen("data/receipt_details.dat", "w");
-    if (file != NULL) {
+    file = fopen("data/receipt_details.dat.tmp", "w");
+    if (file == NULL) {
+        printf("Error: Cannot save receipt details to file.\n");
+        saved = 0;
+    } else {
         for (int i = 0; i < receipt_detail_count; i++) {
-            fprintf(file, "%s,%d,%s,%d,%.2f,%.2f\n", 
-                    receipt_details[i].receipt_id, 
-                    receipt_details[i].item_id, 
-                    receipt_details[i].item_name, 
-                    receipt_details[i].quantity, 
-                    receipt_details[i].price, 
-                    receipt_details[i].total);
+            write_detail_row(file, &receipt_details[i]);
         }
-        fclose(file);
+        if (replace_file(file, "data/receipt_details.dat.tmp", "data/receipt_details.dat")) {
+            details_on_disk = receipt_detail_count;
+        } else {
+            saved = 0;
+        }
+    }
+    
+    analytics_save_digests();
+    return saved;
+}
+
+// Writes items, receipts and digests out in full and empties the journal.
+// Called with the store lock held, or before any lane is running, and
+// never while a periodic checkpoint is being written. Once a journal
+// write has failed, memory may hold sales the journal lacks, and nothing
+// is saved. If any file cannot be replaced the journal is kept, since it
+// is then the only copy of the sales since the last checkpoint. Returns
+// 1 if the journal was emptied.
+int checkpoint_store() {
+    if (journal_failed()) {
+        printf("Error: Not saving; the transaction journal could not be written.\n");
+        return 0;
+    }
+    int saved = save_items();
+    saved = save_receipts() && saved;
+    if (!saved) {
+        printf("Error: Checkpoint incomplete; keeping the transaction journal.\n");
+        return 0;
+    }
+    journal_reset();
+    return 1;
+}
+
+// What a periodic checkpoint saves: the catalog, and the receipts and
+// lines added since the receipt files were last written
+typedef struct {
+    Item items[MAX_ITEMS];
+    int item_count;
+    Receipt* receipts;
+    int receipts_from, receipts_to;
+    ReceiptDetail* details;
+    int details_from, details_to;
+    off_t journal_mark;
+} CheckpointSnapshot;
+
+static CheckpointSnapshot snapshot;
+static int checkpoint_running = 0;     // guarded by the store lock
+
+// Starts a periodic checkpoint once enough records have built up. Under
+// the store lock it copies only the catalog and the rows added since the
+// last checkpoint, so the time the lock is held does not grow with the
+// history. Returns 1 if the caller must finish it with
+// write_checkpoint() after releasing the lock.
+static int begin_checkpoint(int pending) {
+    if (pending < JOURNAL_CHECKPOINT_RECORDS || journal_batching() || checkpoint_running) {
+        return 0;
+    }
+    int receipt_rows = receipt_count - receipts_on_disk;
+    int detail_rows = receipt_detail_count - details_on_disk;
+    Receipt* new_receipts = malloc((receipt_rows + 1) * sizeof(Receipt));
+    ReceiptDetail* new_details = malloc((detail_rows + 1) * sizeof(ReceiptDetail));
+    if (new_receipts == NULL || new_details == NULL) {
+        // Not fatal: the records stay in the journal until the next try
+        free(new_receipts);
+        free(new_details);
+        return 0;
+    }
+    memcpy(new_receipts, &receipts[receipts_on_disk], receipt_rows * sizeof(Receipt));
+    memcpy(new_details, &receipt_details[details_on_disk], detail_rows * sizeof(ReceiptDetail));
+    snapshot.item_count = snapshot_items(snapshot.items);
+    snapshot.receipts = new_receipts;
+    snapshot.receipts_from = receipts_on_disk;
+    snapshot.receipts_to = receipt_count;
+    snapshot.details = new_details;
+    snapshot.details_from = details_on_disk;
+    snapshot.details_to = receipt_detail_count;
+    snapshot.journal_mark = journal_mark();
+    checkpoint_running = 1;
+    return 1;
+}
+
+// Replaces path with its current contents plus rows written by add_rows.
+// The file holds exactly the rows saved so far, so the old ones are
+// copied as bytes rather than formatted again.
+static int extend_file(const char* path, const char* temp_path,
+                       void (*add_rows)(FILE* file, int first, int last), int first, int last) {
+    FILE* out = fopen(temp_path, "w");
+    if (out == NULL) {
+        printf("Error: Cannot update %s.\n", path);
+        return 0;
+    }
+    FILE* in = fopen(path, "r");
+    if (in != NULL) {
+        char block[65536];
+        size_t got;
+        while ((got = fread(block, 1, sizeof(block), in)) > 0) {
+            fwrite(block, 1, got, out);
+        }
+        fclose(in);
+    }
+    add_rows(out, first, last);
+    return replace_file(out, temp_path, path);
+}
+
+static void add_snapshot_receipts(FILE* file, int first, int last) {
+    for (int i = first; i < last; i++) {
+        write_receipt_row(file, &snapshot.receipts[i - snapshot.receipts_from]);
+    }
+}
+
+static void add_snapshot_details(FILE* file, int first, int last) {
+    for (int i = first; i < last; i++) {
+        write_detail_row(file, &snapshot.details[i - snapshot.details_from]);
+    }
+}
+
+// Saves the snapshot taken by begin_checkpoint() without the store lock,
+// while lanes go on checking out, then drops the journal records it
+// covers. If any file cannot be replaced the journal is kept whole.
+static void write_checkpoint() {
+    int saved = save_item_list(snapshot.items, snapshot.item_count);
+    int receipts_saved = extend_file("data/receipts.dat", "data/receipts.dat.tmp", add_snapshot_receipts,
+                                     snapshot.receipts_from, snapshot.receipts_to);
+    int details_saved = extend_file("data/receipt_details.dat", "data/receipt_details.dat.tmp",
+                                    add_snapshot_details, snapshot.details_from, snapshot.details_to);
+    if (saved && receipts_saved && details_saved) {
+        journal_trim(snapshot.journal_mark);
+    } else {
+        printf("Error: Checkpoint incomplete; keeping the transaction journal.\n");
+    }
+
+    lock_store();
+    if (receipts_saved) {
+        receipts_on_disk = snapshot.receipts_to;
+    }
+    if (details_saved) {
+        details_on_disk = snapshot.details_to;
+    }
+    checkpoint_running = 0;
+    unlock_store();
+    free(snapshot.receipts);
+    free(snapshot.details);
+}
+
+// Applies a journal record found at startup. A crash during a checkpoint
+// can leave a record whose receipt or lines already reached the data
+// files; those parts are skipped, and stock is logged as a final value.
+static void restore_record(const JournalRecord* record) {
+    int number = receipt_number(record->receipt.receipt_id);
+    reserve_receipts(1, record->line_count);
+    if (number >= next_receipt_number) {
+        receipts[receipt_count] = record->receipt;
+        index_receipt(receipt_count);
+        receipt_count++;
+        next_receipt_number = number + 1;
+    }
+    if (number > details_through) {
+        memcpy(&receipt_details[receipt_detail_count], record->lines,
+               record->line_count * sizeof(ReceiptDetail));
+        index_detail(receipt_detail_count);
+        receipt_detail_count += record->line_count;
+        details_through = number;
+        if (record->receipt.refund_of[0] != '\0') {
+            note_refund(&record->receipt, record->lines, record->line_count);
+        }
+    }
+    for (int i = 0; i < record->line_count; i++) {
+        Item* item = find_item_by_id(record->lines[i].item_id);
+        if (item != NULL) {
+            set_item_stock(item, record->stock[i]);
+        }
+    }
+}
+
+// Adds a journaled receipt and its lines to the history, indexes them
+// and updates the report aggregates. Called with the store lock held.
+static void append_record(const JournalRecord* record) {
+    const Receipt* header = &record->receipt;
+    reserve_receipts(1, record->line_count);
+    receipts[receipt_count] = *header;
+    index_receipt(receipt_count);
+    receipt_count++;
+    memcpy(&receipt_details[receipt_detail_count], record->lines, record->line_count * sizeof(ReceiptDetail));
+    index_detail(receipt_detail_count);
+    receipt_detail_count += record->line_count;
+    
+    data_changed(DATA_RECEIPTS, 0);
+    data_changed(DATA_RECEIPTS_BY_DAY, date_key(header->date));
+    data_changed(DATA_RECEIPTS_BY_CUSTOMER, header->customer_id);
+    analytics_record_receipt(&receipts[receipt_count - 1],
+                             &receipt_details[receipt_detail_count - record->line_count],
+                             record->line_count);
+}
+
+// Numbers the sale, queues its journal record and then applies it:
+// receipt, lines, analytics, customer spend and stock. Called with the
+// store lock held; the caller waits on ticket once the lock is released,
+// then writes the checkpoint if one was started. Returns 0 without
+// changing anything if the journal cannot be written.
+static int store_sale(Cart* cart, Customer* customer, JournalRecord* record, unsigned long* ticket,
+                      int* checkpoint) {
+    Receipt* header = &record->receipt;
+    snprintf(header->receipt_id, sizeof(header->receipt_id), "R%03d", next_receipt_number);
+    for (int i = 0; i < cart->count; i++) {
+        strcpy(record->lines[i].receipt_id, header->receipt_id);
+        record->stock[i] = cart_line_item(&cart->items[i])->stock - cart->items[i].quantity;
+    }
+    int pending = journal_append(record, ticket);
+    if (pending == 0) {
+        return 0;
+    }
+    next_receipt_number++;
+    append_record(record);
+    pricing_record_sale(customer, header->total_amount);
+    
+    // The cart's reserved units become sales
+    for (int i = 0; i < cart->count; i++) {
+        commit_stock(cart_line_item(&cart->items[i]), cart->items[i].quantity);
+    }
+    *checkpoint = begin_checkpoint(pending);
+    return 1;
+}
+
+// A sale is applied in memory before its journal record reaches the
+// disk. If the record cannot be written, memory is ahead of the journal:
+// stop without saving rather than carry on from stock and receipts that
+// a restart would not know about.
+static void wait_for_journal(unsigned long ticket) {
+    if (!journal_sync(ticket)) {
+        printf("Stopping. Sales not in the journal are lost.\n");
+        exit(1);
     }
 }
 
-char* generate_receipt(Customer* customer) {
-    if (is_cart_empty()) {
+// Checks out the lane's cart for the lane's customer and empties the
+// cart. The cart is priced without holding the store lock. Under it the
+// sale is numbered, queued for the journal as one record and applied;
+// outside it the lane waits for the record to reach the disk, sharing the
+// fsync with any lanes checking out at the same time. Only then is the
+// sale reported. Fills receipt, optionally prints it, and returns 1 on
+// success.
+int generate_receipt(Lane* lane, Receipt* receipt, int print) {
+    Cart* cart = &lane->cart;
+    Customer* customer = lane->customer;
+    if (is_cart_empty(cart)) {
         printf("Cart is empty! Cannot generate receipt.\n");
-        return NULL;
+        return 0;
     }
     
-    static char receipt_id[10];
-    strcpy(receipt_id, get_next_receipt_id());
+    // One clock reading so the stored date, timestamp and printed time agree
+    time_t now = time(NULL);
+    struct tm tm;
+    localtime_r(&now, &tm);
     
-    char date_str[MAX_DATE_LEN];
-    get_current_date(date_str);
+    // Lines for the journal record; a typical basket fits on the stack
+    ReceiptDetail inline_details[CART_INLINE_LINES];
+    int inline_stock[CART_INLINE_LINES];
+    money_t inline_discounts[CART_INLINE_LINES];
+    JournalRecord record;
+    money_t* line_discounts = inline_discounts;
+    record.lines = inline_details;
+    record.stock = inline_stock;
+    if (cart->count > CART_INLINE_LINES) {
+        record.lines = malloc(cart->count * sizeof(ReceiptDetail));
+        record.stock = malloc(cart->count * sizeof(int));
+        line_discounts = malloc(cart->count * sizeof(money_t));
+        if (record.lines == NULL || record.stock == NULL || line_discounts == NULL) {
+            printf("Error: Out of memory generating receipt.\n");
+            exit(1);
+        }
+    }
     
-    float total_amount = get_cart_total();
+    PricingResult pricing;
+    price_cart_lines(cart, customer, &pricing, line_discounts);
     
     // Create receipt record
-    Receipt new_receipt;
-    strcpy(new_receipt.receipt_id, receipt_id);
-    new_receipt.customer_id = customer->id;
-    strcpy(new_receipt.date, date_str);
-    new_receipt.total_amount = total_amount;
-    
-    receipts[receipt_count] = new_receipt;
-    receipt_count++;
+    Receipt* header = &record.receipt;
+    header->customer_id = customer->id;
+    strftime(header->date, sizeof(header->date), "%Y-%m-%d", &tm);
+    header->total_amount = pricing.total;
+    header->timestamp = (int64_t)now;
+    header->discount_amount = pricing.promotions + pricing.discount;
+    header->tax_amount = pricing.tax;
+    header->refund_of[0] = '\0';
     
     // Create receipt details
-    for (int i = 0; i < cart.count; i++) {
-        ReceiptDetail detail;
-        strcpy(detail.receipt_id, receipt_id);
-        detail.item_id = cart.items[i].item.id;
-        strcpy(detail.item_name, cart.items[i].item.name);
-        detail.quantity = cart.items[i].quantity;
-        detail.price = cart.items[i].item.price;
-        detail.total = cart.items[i].item.price * cart.items[i].quantity;
-        
-        receipt_details[receipt_detail_count] = detail;
-        receipt_detail_count++;
-        
-        // Update stock
-        update_item_stock(cart.items[i].item.id, cart.items[i].quantity);
+    record.line_count = cart->count;
+    for (int i = 0; i < cart->count; i++) {
+        ReceiptDetail* detail = &record.lines[i];
+        const CartItem* line = &cart->items[i];
+        detail->item_id = cart_line_item(line)->id;
+        strcpy(detail->item_name, cart_line_item(line)->name);
+        detail->quantity = line->quantity;
+        detail->price = line->price;
+        detail->total = line->price * line->quantity;
+        detail->discount = line_discounts[i];
     }
     
-    save_receipts();
-    display_receipt(customer, receipt_id, total_amount);
+    unsigned long ticket = 0;
+    int checkpoint = 0;
+    lock_store();
+    int stored = store_sale(cart, customer, &record, &ticket, &checkpoint);
+    unlock_store();
     
-    return receipt_id;
+    *receipt = *header;
+    if (record.lines != inline_details) {
+        free(record.lines);
+        free(record.stock);
+        free(line_discounts);
+    }
+    if (!stored) {
+        printf("Checkout failed! The sale was not recorded.\n");
+        return 0;
+    }
+    wait_for_journal(ticket);
+    if (checkpoint) {
+        write_checkpoint();
+    }
+    
+    if (print) {
+        display_receipt(receipt, customer, cart, &pricing);
+    }
+    checkout_cart(cart);
+    return 1;
 }
 
-void display_receipt(Customer* customer, const char* receipt_id, float total) {
-    time_t t = time(NULL);
+void display_receipt(const Receipt* receipt, const Customer* customer, const Cart* cart,
+                     const PricingResult* pricing) {
+    time_t t = (time_t)receipt->timestamp;
     struct tm tm = *localtime(&t);
     
     printf("\n==================================================\n");
@@ -133,7 +619,7 @@ void display_receipt(Customer* customer, const char* receipt_id, float total) {
     printf("Date: %04d-%02d-%02d        Time: %02d:%02d:%02d\n", 
            tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday,
            tm.tm_hour, tm.tm_min, tm.tm_sec);
-    printf("Receipt ID: %s\n", receipt_id);
+    printf("Receipt ID: %s\n", receipt->receipt_id);
     printf("--------------------------------------------------\n");
     printf("Customer: %s\n", customer->name);
     printf("Phone: %s\n", customer->phone);
@@ -142,37 +628,317 @@ void display_receipt(Customer* customer, const char* receipt_id, float total) {
     printf("%-8s %-20s %-5s %-10s %-10s\n", "Item ID", "Item Name", "Qty", "Price", "Total");
     printf("--------------------------------------------------\n");
     
-    for (int i = 0; i < cart.count; i++) {
-        float line_total = cart.items[i].item.price * cart.items[i].quantity;
-        printf("%-8d %-20s %-5d $%-9.2f $%-9.2f\n", 
-               cart.items[i].item.id, 
-               cart.items[i].item.name, 
-               cart.items[i].quantity, 
-               cart.items[i].item.price, 
-               line_total);
+    char price[MONEY_STR_LEN], amount[MONEY_STR_LEN];
+    for (int i = 0; i < cart->count; i++) {
+        const CartItem* line = &cart->items[i];
+        money_t line_total = line->price * line->quantity;
+        printf("%-8d %-20s %-5d $%-9s $%-9s\n", 
+               cart_line_item(line)->id, 
+               cart_line_item(line)->name, 
+               line->quantity, 
+               money_format(line->price, price), 
+               money_format(line_total, amount));
     }
     
     printf("--------------------------------------------------\n");
-    printf("%-40s $%.2f\n", "TOTAL AMOUNT", total);
+    printf("%-40s $%s\n", "Subtotal", money_format(pricing->subtotal, amount));
+    const Promo* applied[MAX_PROMOS];
+    money_t discounts[MAX_PROMOS];
+    int applied_count = promotions_applied(&cart->promotions, applied, discounts, MAX_PROMOS);
+    for (int i = 0; i < applied_count; i++) {
+        printf("  %-37s -$%s\n", applied[i]->name, money_format(discounts[i], amount));
+    }
+    if (pricing->discount > 0) {
+        char label[48];
+        snprintf(label, sizeof(label), "Discount (%s %d.%02d%%)", tier_name(pricing->tier),
+                 tier_rate(pricing->tier) / 100, tier_rate(pricing->tier) % 100);
+        printf("%-39s -$%s\n", label, money_format(pricing->discount, amount));
+    }
+    for (int i = 0; i < tax_slab_count(); i++) {
+        if (pricing->slab_tax[i] > 0) {
+            char label[48];
+            snprintf(label, sizeof(label), "GST %s (%d.%02d%%)", tax_slab_name(i),
+                     tax_slab_rate(i) / 100, tax_slab_rate(i) % 100);
+            printf("%-40s $%s\n", label, money_format(pricing->slab_tax[i], amount));
+        }
+    }
+    printf("--------------------------------------------------\n");
+    printf("%-40s $%s\n", "TOTAL AMOUNT", money_format(pricing->total, amount));
     printf("==================================================\n");
     printf("           Thank you for shopping with us!\n");
     printf("==================================================\n");
 }
 
-char* get_next_receipt_id() {
-    static char next_id[10];
-    int max_num = 0;
+// Share of amount for part of whole, rounded to the nearest unit
+static money_t money_share(money_t amount, money_t part, money_t whole) {
+    return whole > 0 ? (amount * part + whole / 2) / whole : 0;
+}
+
+// Receipts saved before line discounts were kept have only the total.
+// It is shared across their lines by value, cumulatively so the lines
+// add up to it exactly. Refunds are negative throughout, so their shares
+// are taken on the magnitudes.
+static void share_unknown_discounts() {
+    for (int r = 0; r < receipt_count; r++) {
+        int first;
+        int count = receipt_lines(receipt_number(receipts[r].receipt_id), &first);
+        if (count == 0 || receipt_details[first].discount != DISCOUNT_UNKNOWN) {
+            continue;
+        }
+        int sign = receipts[r].refund_of[0] != '\0' ? -1 : 1;
+        money_t whole = 0;
+        for (int i = first; i < first + count; i++) {
+            whole += sign * receipt_details[i].total;
+        }
+        money_t before = 0;
+        for (int i = first; i < first + count; i++) {
+            money_t after = before + sign * receipt_details[i].total;
+            receipt_details[i].discount = sign * (money_share(sign * receipts[r].discount_amount, after, whole) -
+                                                  money_share(sign * receipts[r].discount_amount, before, whole));
+            before = after;
+        }
+    }
+}
+
+// Finds the sale, checks the returns against what is left to return on
+// it and queues the refund for the journal, then applies it: receipt,
+// lines, returned units, analytics, customer spend and stock. Called with
+// the store lock held; the caller waits on ticket once it is released,
+// then writes the checkpoint if one was started. Returns 0 without
+// changing anything if the refund is refused.
+static int store_refund(const char* receipt_id, const ReturnLine* returns, int return_count,
+                        JournalRecord* record, unsigned long* ticket, int* checkpoint) {
+    int number = receipt_number(receipt_id);
+    int64_t* slot = intmap_get(&receipt_slots, (uint64_t)number);
+    if (number == 0 || slot == NULL) {
+        printf("Receipt %s not found.\n", receipt_id);
+        return 0;
+    }
+    const Receipt* sale = &receipts[*slot];
+    if (sale->refund_of[0] != '\0') {
+        printf("Receipt %s is a refund and cannot be returned.\n", receipt_id);
+        return 0;
+    }
+    int first;
+    int line_count = receipt_lines(number, &first);
     
-    for (int i = 0; i < receipt_count; i++) {
-        int num;
-        if (sscanf(receipts[i].receipt_id, "R%d", &num) == 1) {
-            if (num > max_num) {
-                max_num = num;
+    // Each returned line pays back its own discount and the GST charged
+    // on it at its item's slab rate. Scaling the line's cumulative share
+    // rather than each refund on its own means a line refunded in several
+    // goes pays back exactly what it was charged. A sale that charged no
+    // GST, as receipts from before GST slabs did, refunds none.
+    money_t returned_now = 0, discount = 0, tax = 0;
+    for (int i = 0; i < return_count; i++) {
+        int row = find_receipt_line(first, line_count, returns[i].item_id);
+        if (row < 0) {
+            printf("Item %d is not on receipt %s.\n", returns[i].item_id, receipt_id);
+            return 0;
+        }
+        for (int j = 0; j < i; j++) {
+            if (returns[j].item_id == returns[i].item_id) {
+                printf("Item %d is listed twice.\n", returns[i].item_id);
+                return 0;
             }
         }
+        const ReceiptDetail* sold = &receipt_details[row];
+        int left = sold->quantity - returned_units[row];
+        if (returns[i].quantity <= 0 || returns[i].quantity > left) {
+            printf("Item %d: %d of %d units can still be returned.\n",
+                   returns[i].item_id, left, sold->quantity);
+            return 0;
+        }
+        
+        Item* item = find_item_by_id(sold->item_id);
+        money_t taxable = sold->total - sold->discount;
+        money_t line_tax = item && sale->tax_amount != 0 ? item_line_tax(item, taxable) : 0;
+        int before = returned_units[row];
+        int after = before + returns[i].quantity;
+        money_t line_discount = money_share(sold->discount, after, sold->quantity) -
+                                money_share(sold->discount, before, sold->quantity);
+        
+        ReceiptDetail* line = &record->lines[i];
+        *line = *sold;
+        line->quantity = -returns[i].quantity;
+        line->total = -line->price * returns[i].quantity;
+        line->discount = -line_discount;
+        returned_now -= line->total;
+        discount += line_discount;
+        tax += money_share(line_tax, after, sold->quantity) - money_share(line_tax, before, sold->quantity);
+        record->stock[i] = item ? item->stock + returns[i].quantity : 0;
+    }
+    
+    Receipt* header = &record->receipt;
+    money_t total = returned_now - discount + tax;
+    header->customer_id = sale->customer_id;
+    header->total_amount = -total;
+    header->discount_amount = -discount;
+    header->tax_amount = -tax;
+    strcpy(header->refund_of, sale->receipt_id);
+    snprintf(header->receipt_id, sizeof(header->receipt_id), "R%03d", next_receipt_number);
+    for (int i = 0; i < return_count; i++) {
+        strcpy(record->lines[i].receipt_id, header->receipt_id);
+    }
+    record->line_count = return_count;
+    
+    int pending = journal_append(record, ticket);
+    if (pending == 0) {
+        return 0;
+    }
+    next_receipt_number++;
+    append_record(record);
+    note_refund(header, record->lines, return_count);
+    
+    Customer* customer = find_customer_by_id(header->customer_id);
+    if (customer != NULL) {
+        pricing_record_sale(customer, header->total_amount);
+    }
+    for (int i = 0; i < return_count; i++) {
+        Item* item = find_item_by_id(record->lines[i].item_id);
+        if (item != NULL) {
+            restock_item(item, -record->lines[i].quantity);
+        }
+    }
+    *checkpoint = begin_checkpoint(pending);
+    return 1;
+}
+
+static void display_refund(const JournalRecord* record) {
+    const Receipt* refund = &record->receipt;
+    time_t t = (time_t)refund->timestamp;
+    struct tm tm = *localtime(&t);
+    const Customer* customer = find_customer_by_id(refund->customer_id);
+    
+    printf("\n==================================================\n");
+    printf("                XYZ RETAIL STORE\n");
+    printf("                 REFUND RECEIPT\n");
+    printf("==================================================\n");
+    printf("Date: %04d-%02d-%02d        Time: %02d:%02d:%02d\n", 
+           tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday,
+           tm.tm_hour, tm.tm_min, tm.tm_sec);
+    printf("Receipt ID: %s (refund of %s)\n", refund->receipt_id, refund->refund_of);
+    printf("--------------------------------------------------\n");
+    printf("Customer: %s\n", customer ? customer->name : "(unknown)");
+    printf("--------------------------------------------------\n");
+    printf("%-8s %-20s %-5s %-10s %-10s\n", "Item ID", "Item Name", "Qty", "Price", "Total");
+    printf("--------------------------------------------------\n");
+    
+    char price[MONEY_STR_LEN], amount[MONEY_STR_LEN];
+    money_t returned = 0;
+    for (int i = 0; i < record->line_count; i++) {
+        const ReceiptDetail* line = &record->lines[i];
+        returned += line->total;
+        printf("%-8d %-20s %-5d $%-9s $%-9s\n", 
+               line->item_id, 
+               line->item_name, 
+               line->quantity, 
+               money_format(line->price, price), 
+               money_format(line->total, amount));
+    }
+    
+    printf("--------------------------------------------------\n");
+    printf("%-40s $%s\n", "Goods returned", money_format(returned, amount));
+    if (refund->discount_amount != 0) {
+        printf("%-39s -$%s\n", "Less discount", money_format(-refund->discount_amount, amount));
+    }
+    if (refund->tax_amount != 0) {
+        printf("%-40s $%s\n", "GST refunded", money_format(refund->tax_amount, amount));
+    }
+    printf("--------------------------------------------------\n");
+    printf("%-40s $%s\n", "TOTAL REFUND", money_format(-refund->total_amount, amount));
+    printf("==================================================\n");
+}
+
+// Lists the lines of a sale with the units still returnable. Returns the
+// number of lines, or 0 if there is no such sale.
+int show_returnable_lines(const char* receipt_id) {
+    lock_store();
+    int number = receipt_number(receipt_id);
+    int64_t* slot = intmap_get(&receipt_slots, (uint64_t)number);
+    if (number == 0 || slot == NULL || receipts[*slot].refund_of[0] != '\0') {
+        unlock_store();
+        return 0;
+    }
+    
+    char amount[MONEY_STR_LEN], price[MONEY_STR_LEN];
+    const Receipt* sale = &receipts[*slot];
+    printf("\nReceipt ID: %s | Date: %s | Amount: $%s\n",
+           sale->receipt_id, sale->date, money_format(sale->total_amount, amount));
+    printf("%-8s %-20s %-5s %-10s %-10s\n", "Item ID", "Item Name", "Sold", "Price", "Returnable");
+    printf("--------------------------------------------------\n");
+    int first;
+    int line_count = receipt_lines(number, &first);
+    for (int i = first; i < first + line_count; i++) {
+        printf("%-8d %-20s %-5d $%-9s %-10d\n",
+               receipt_details[i].item_id,
+               receipt_details[i].item_name,
+               receipt_details[i].quantity,
+               money_format(receipt_details[i].price, price),
+               receipt_details[i].quantity - returned_units[i]);
+    }
+    unlock_store();
+    return line_count;
+}
+
+// Returns items from an earlier sale. The refund is a receipt of its own
+// with negative quantities and amounts, naming the sale in refund_of; its
+// total, discount and tax are the sale's scaled by the share of the
+// subtotal being returned. The sale and its lines are found through the
+// receipt indexes, so the work grows with the receipt, not the history.
+// Restocks the items, fills refund, optionally prints it, and returns 1
+// on success.
+int refund_receipt(const char* receipt_id, const ReturnLine* returns, int return_count,
+                   Receipt* refund, int print) {
+    if (return_count < 1) {
+        printf("Nothing to return.\n");
+        return 0;
+    }
+    
+    ReceiptDetail inline_details[CART_INLINE_LINES];
+    int inline_stock[CART_INLINE_LINES];
+    JournalRecord record;
+    record.lines = inline_details;
+    record.stock = inline_stock;
+    if (return_count > CART_INLINE_LINES) {
+        record.lines = malloc(return_count * sizeof(ReceiptDetail));
+        record.stock = malloc(return_count * sizeof(int));
+        if (record.lines == NULL || record.stock == NULL) {
+            printf("Error: Out of memory generating refund.\n");
+            exit(1);
+        }
     }
     
-    snprintf(next_id, sizeof(next_id), "R%03d", max_num + 1);
+    time_t now = time(NULL);
+    struct tm tm;
+    localtime_r(&now, &tm);
+    strftime(record.receipt.date, sizeof(record.receipt.date), "%Y-%m-%d", &tm);
+    record.receipt.timestamp = (int64_t)now;
+    
+    unsigned long ticket = 0;
+    int checkpoint = 0;
+    lock_store();
+    int stored = store_refund(receipt_id, returns, return_count, &record, &ticket, &checkpoint);
+    unlock_store();
+    
+    if (stored) {
+        wait_for_journal(ticket);
+        if (checkpoint) {
+            write_checkpoint();
+        }
+        *refund = record.receipt;
+        if (print) {
+            display_refund(&record);
+        }
+    }
+    if (record.lines != inline_details) {
+        free(record.lines);
+        free(record.stock);
+    }
+    return stored;
+}
+
+char* get_next_receipt_id() {
+    static char next_id[10];
+    snprintf(next_id, sizeof(next_id), "R%03d", next_receipt_number);
     return next_id;
 }
 
@@ -189,97 +955,124 @@ void get_current_time(char* time_str) {
 }
 
 void daily_sales_report(const char* date) {
-    printf("\n==================================================\n");
-    printf("           DAILY SALES REPORT - %s\n", date);
-    printf("==================================================\n");
+    ReportParams params = {"", "", 0, 0, 0};
+    strncpy(params.from_date, date, MAX_DATE_LEN - 1);
+    if (report_cache_begin(REPORT_DAILY_SALES, &params)) {
+        return;
+    }
     
-    float total_sales = 0;
+    report_printf("\n==================================================\n");
+    report_printf("           DAILY SALES REPORT - %s\n", date);
+    report_printf("==================================================\n");
+    
+    money_t total_sales = 0;
     int total_transactions = 0;
+    int refund_count = 0;
+    char amount[MONEY_STR_LEN], p50[MONEY_STR_LEN], p90[MONEY_STR_LEN], p99[MONEY_STR_LEN];
     
-    printf("%-12s %-12s %-12s\n", "Receipt ID", "Customer ID", "Amount");
-    printf("------------------------------------------\n");
+    report_printf("%-12s %-12s %-12s\n", "Receipt ID", "Customer ID", "Amount");
+    report_printf("------------------------------------------\n");
     
     for (int i = 0; i < receipt_count; i++) {
         if (strcmp(receipts[i].date, date) == 0) {
+            // Refunds count against the day's sales but are not transactions
             total_sales += receipts[i].total_amount;
-            total_transactions++;
-            printf("%-12s %-12d $%-11.2f\n", 
-                   receipts[i].receipt_id, 
-                   receipts[i].customer_id, 
-                   receipts[i].total_amount);
+            if (receipts[i].refund_of[0] != '\0') {
+                refund_count++;
+            } else {
+                total_transactions++;
+            }
+            report_printf("%-12s %-12d $%-11s\n", 
+                          receipts[i].receipt_id, 
+                          receipts[i].customer_id, 
+                          money_format(receipts[i].total_amount, amount));
         }
     }
     
-    if (total_transactions == 0) {
-        printf("No sales found for this date.\n");
+    if (total_transactions + refund_count == 0) {
+        report_printf("No sales found for this date.\n");
     } else {
-        printf("------------------------------------------\n");
-        printf("Total Transactions: %d\n", total_transactions);
-        printf("Total Sales: $%.2f\n", total_sales);
-        printf("Average Transaction: $%.2f\n", total_sales / total_transactions);
+        report_printf("------------------------------------------\n");
+        report_printf("Total Transactions: %d\n", total_transactions);
+        if (refund_count > 0) {
+            report_printf("Refunds: %d\n", refund_count);
+        }
+        report_printf("Total Sales: $%s\n", money_format(total_sales, amount));
+        if (total_transactions > 0) {
+            report_printf("Average Transaction: $%s\n",
+                          money_format((total_sales + total_transactions / 2) / total_transactions, amount));
+        }
+        
+        TDigest amounts;
+        int day = date_key(date);
+        if (analytics_amount_distribution(day, day, &amounts) > 0) {
+            report_printf("Basket p50 / p90 / p99: $%s / $%s / $%s\n",
+                          money_format(money_from_double(tdigest_quantile(&amounts, 0.50)), p50),
+                          money_format(money_from_double(tdigest_quantile(&amounts, 0.90)), p90),
+                          money_format(money_from_double(tdigest_quantile(&amounts, 0.99)), p99));
+        }
     }
-    printf("==================================================\n");
+    report_printf("==================================================\n");
+    report_cache_end();
 }
 
 void customer_purchase_history(int customer_id) {
-    printf("\n==================================================\n");
-    printf("    CUSTOMER PURCHASE HISTORY - ID: %d\n", customer_id);
-    printf("==================================================\n");
+    ReportParams params = {"", "", customer_id, 0, 0};
+    if (report_cache_begin(REPORT_CUSTOMER_HISTORY, &params)) {
+        return;
+    }
+    
+    report_printf("\n==================================================\n");
+    report_printf("    CUSTOMER PURCHASE HISTORY - ID: %d\n", customer_id);
+    report_printf("==================================================\n");
     
-    float total_spent = 0;
+    money_t total_spent = 0;
     int purchase_count = 0;
+    char amount[MONEY_STR_LEN], price[MONEY_STR_LEN];
     
     for (int i = 0; i < receipt_count; i++) {
         if (receipts[i].customer_id == customer_id) {
             total_spent += receipts[i].total_amount;
             purchase_count++;
             
-            printf("\nReceipt ID: %s | Date: %s | Amount: $%.2f\n", 
-                   receipts[i].receipt_id, 
-                   receipts[i].date, 
-                   receipts[i].total_amount);
+            report_printf("\nReceipt ID: %s | Date: %s | Amount: $%s\n", 
+                          receipts[i].receipt_id, 
+                          receipts[i].date, 
+                          money_format(receipts[i].total_amount, amount));
             
             // Show items for this receipt
             for (int j = 0; j < receipt_detail_count; j++) {
                 if (strcmp(receipt_details[j].receipt_id, receipts[i].receipt_id) == 0) {
-                    printf("  - %s x%d @ $%.2f = $%.2f\n", 
-                           receipt_details[j].item_name, 
-                           receipt_details[j].quantity, 
-                           receipt_details[j].price, 
-                           receipt_details[j].total);
+                    report_printf("  - %s x%d @ $%s = $%s\n", 
+                                  receipt_details[j].item_name, 
+                                  receipt_details[j].quantity, 
+                                  money_format(receipt_details[j].price, price), 
+                                  money_format(receipt_details[j].total, amount));
                 }
             }
         }
     }
     
     if (purchase_count == 0) {
-        printf("No purchase history found for this customer.\n");
+        report_printf("No purchase history found for this customer.\n");
     } else {
-        printf("--------------------------------------------------\n");
-        printf("Total Purchases: %d\n", purchase_count);
-        printf("Total Amount Spent: $%.2f\n", total_spent);
+        report_printf("--------------------------------------------------\n");
+        report_printf("Total Purchases: %d\n", purchase_count);
+        report_printf("Total Amount Spent: $%s\n", money_format(total_spent, amount));
     }
-    printf("==================================================\n");
+    report_printf("==================================================\n");
+    report_cache_end();
 }
 
-void item_sales_summary() {
-    printf("\n==================================================\n");
-    printf("                ITEM SALES SUMMARY\n");
-    printf("==================================================\n");
-    
-    if (receipt_detail_count == 0) {
-        printf("No sales data available.\n");
-        return;
-    }
-    
-    typedef struct {
-        int item_id;
-        char item_name[MAX_NAME_LEN];
-        int quantity_sold;
-        float total_revenue;
-    } ItemStats;
-    
-    ItemStats stats[MAX_ITEMS];
+typedef struct {
+    int item_id;
+    char item_name[MAX_NAME_LEN];
+    int quantity_sold;
+    money_t total_revenue;
+} ItemStats;
+
+// Aggregates sales per item, sorted by revenue (descending)
+static int collect_item_stats(ItemStats* stats) {
     int stat_count = 0;
     
     // Aggregate item sales
@@ -313,25 +1106,1029 @@ void item_sales_summary() {
             }
         }
     }
+    return stat_count;
+}
+
+void item_sales_summary() {
+    ReportParams params = {"", "", 0, 0, 0};
+    if (report_cache_begin(REPORT_ITEM_SALES, &params)) {
+        return;
+    }
     
-    printf("%-8s %-20s %-10s %-12s\n", "Item ID", "Item Name", "Qty Sold", "Revenue");
-    printf("--------------------------------------------------\n");
+    report_printf("\n==================================================\n");
+    report_printf("                ITEM SALES SUMMARY\n");
+    report_printf("==================================================\n");
+    
+    if (receipt_detail_count == 0) {
+        report_printf("No sales data available.\n");
+        report_cache_end();
+        return;
+    }
+    
+    ItemStats stats[MAX_ITEMS];
+    int stat_count = collect_item_stats(stats);
+    
+    report_printf("%-8s %-20s %-10s %-12s\n", "Item ID", "Item Name", "Qty Sold", "Revenue");
+    report_printf("--------------------------------------------------\n");
     
-    float total_revenue = 0;
+    money_t total_revenue = 0;
     int total_quantity = 0;
+    char amount[MONEY_STR_LEN];
     
     for (int i = 0; i < stat_count; i++) {
         total_revenue += stats[i].total_revenue;
         total_quantity += stats[i].quantity_sold;
-        printf("%-8d %-20s %-10d $%-11.2f\n", 
-               stats[i].item_id, 
-               stats[i].item_name, 
-               stats[i].quantity_sold, 
-               stats[i].total_revenue);
+        report_printf("%-8d %-20s %-10d $%-11s\n", 
+                      stats[i].item_id, 
+                      stats[i].item_name, 
+                      stats[i].quantity_sold, 
+                      money_format(stats[i].total_revenue, amount));
     }
     
+    report_printf("--------------------------------------------------\n");
+    report_printf("Total Items Sold: %d\n", total_quantity);
+    report_printf("Total Revenue: $%s\n", money_format(total_revenue, amount));
+    report_printf("==================================================\n");
+    report_cache_end();
+}
+
+void distinct_customers_report(const char* from_date, const char* to_date, int item_id) {
+    ReportParams params = {"", "", 0, item_id, 0};
+    strncpy(params.from_date, from_date, MAX_DATE_LEN - 1);
+    strncpy(params.to_date, to_date, MAX_DATE_LEN - 1);
+    if (report_cache_begin(REPORT_DISTINCT_CUSTOMERS, &params)) {
+        return;
+    }
+
+    report_printf("\n==================================================\n");
+    report_printf("               DISTINCT CUSTOMERS\n");
+    report_printf("==================================================\n");
+    report_printf("Period: %s to %s\n", from_date, to_date);
+    if (item_id != 0) {
+        Item* item = find_item_by_id(item_id);
+        report_printf("Item: %d (%s)\n", item_id, item ? item->name : "unknown");
+    } else {
+        report_printf("Item: all items\n");
+    }
+    report_printf("--------------------------------------------------\n");
+
+    HyperLogLog merged;
+    int days = analytics_distinct_customers(date_key(from_date), date_key(to_date), item_id, &merged);
+
+    if (days == 0) {
+        report_printf("No sales found for this period.\n");
+    } else {
+        double estimate = hll_estimate(&merged);
+        double error = hll_standard_error();
+        report_printf("Days with sales: %d\n", days);
+        report_printf("Unique customers: ~%.0f (+/- %.0f, %.1f%% std. error)\n",
+                      estimate, estimate * error, 100.0 * error);
+    }
+    report_printf("==================================================\n");
+    report_cache_end();
+}
+
+void basket_value_report(const char* from_date, const char* to_date) {
+    ReportParams params = {"", "", 0, 0, 0};
+    strncpy(params.from_date, from_date, MAX_DATE_LEN - 1);
+    strncpy(params.to_date, to_date, MAX_DATE_LEN - 1);
+    if (report_cache_begin(REPORT_BASKET_VALUE, &params)) {
+        return;
+    }
+
+    report_printf("\n==================================================\n");
+    report_printf("            BASKET VALUE DISTRIBUTION\n");
+    report_printf("==================================================\n");
+    report_printf("Period: %s to %s\n", from_date, to_date);
+    report_printf("--------------------------------------------------\n");
+
+    TDigest amounts;
+    int days = analytics_amount_distribution(date_key(from_date), date_key(to_date), &amounts);
+
+    if (days == 0) {
+        report_printf("No sales found for this period.\n");
+    } else {
+        report_printf("Days with sales: %d\n", days);
+        report_printf("Transactions: %.0f\n", amounts.total_weight);
+        char amount[MONEY_STR_LEN];
+        report_printf("%-10s $%s\n", "Min", money_format(money_from_double(amounts.min), amount));
+        report_printf("%-10s $%s\n", "p50", money_format(money_from_double(tdigest_quantile(&amounts, 0.50)), amount));
+        report_printf("%-10s $%s\n", "p90", money_format(money_from_double(tdigest_quantile(&amounts, 0.90)), amount));
+        report_printf("%-10s $%s\n", "p99", money_format(money_from_double(tdigest_quantile(&amounts, 0.99)), amount));
+        report_printf("%-10s $%s\n", "Max", money_format(money_from_double(amounts.max), amount));
+    }
+    report_printf("==================================================\n");
+    report_cache_end();
+}
+
+void hourly_heatmap_report() {
+    static const char* weekdays[7] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+
+    ReportParams params = {"", "", 0, 0, 0};
+    if (report_cache_begin(REPORT_HOURLY_HEATMAP, &params)) {
+        return;
+    }
+
+    report_printf("\n==================================================\n");
+    report_printf("         HOURLY SALES HEATMAP (TRANSACTIONS)\n");
+    report_printf("==================================================\n");
+
+    const HourBucket (*heatmap)[24] = analytics_hourly_heatmap();
+    long total = 0;
+    int peak_day = 0, peak_hour = 0;
+    for (int d = 0; d < 7; d++) {
+        for (int h = 0; h < 24; h++) {
+            total += heatmap[d][h].transactions;
+            if (heatmap[d][h].transactions > heatmap[peak_day][peak_hour].transactions) {
+                peak_day = d;
+                peak_hour = h;
+            }
+        }
+    }
+
+    if (total == 0) {
+        report_printf("No timestamped sales found.\n");
+        report_printf("==================================================\n");
+        report_cache_end();
+        return;
+    }
+
+    report_printf("%-6s", "Hour");
+    for (int d = 0; d < 7; d++) {
+        report_printf("%6s", weekdays[d]);
+    }
+    report_printf("\n--------------------------------------------------\n");
+
+    for (int h = 0; h < 24; h++) {
+        report_printf("%02d:00 ", h);
+        for (int d = 0; d < 7; d++) {
+            if (heatmap[d][h].transactions == 0) {
+                report_printf("%6s", ".");
+            } else {
+                report_printf("%6ld", heatmap[d][h].transactions);
+            }
+        }
+        report_printf("\n");
+    }
+
+    report_printf("--------------------------------------------------\n");
+    report_printf("Timestamped transactions: %ld\n", total);
+    char amount[MONEY_STR_LEN];
+    report_printf("Busiest slot: %s %02d:00 (%ld transactions, $%s)\n",
+                  weekdays[peak_day], peak_hour,
+                  heatmap[peak_day][peak_hour].transactions,
+                  money_format(heatmap[peak_day][peak_hour].sales, amount));
+    report_printf("==================================================\n");
+    report_cache_end();
+}
+
+// Inventory valuation over the packed price/stock columns. Plain integer
+// reductions with no branches, which the compiler vectorises.
+typedef struct {
+    money_t total_value;
+    long total_units;
+    int low_stock_count;
+} InventoryTotals;
+
+static InventoryTotals inventory_totals(const money_t* restrict price, const int* restrict stock,
+                                        int n, int threshold) {
+    money_t total_value = 0;
+    long total_units = 0;
+    int low_stock_count = 0;
+
+    for (int i = 0; i < n; i++) {
+        total_value += price[i] * stock[i];
+        total_units += stock[i];
+        low_stock_count += stock[i] < threshold;
+    }
+
+    InventoryTotals totals = {total_value, total_units, low_stock_count};
+    return totals;
+}
+
+void inventory_report(int low_stock_threshold) {
+    ReportParams params = {"", "", 0, 0, low_stock_threshold};
+    if (report_cache_begin(REPORT_INVENTORY, &params)) {
+        return;
+    }
+
+    report_printf("\n==================================================\n");
+    report_printf("          INVENTORY VALUATION & LOW STOCK\n");
+    report_printf("==================================================\n");
+
+    InventoryTotals totals = inventory_totals(item_price_column, item_stock_column,
+                                              item_count, low_stock_threshold);
+
+    char price[MONEY_STR_LEN], value[MONEY_STR_LEN];
+    report_printf("%-5s %-20s %-10s %-8s %-12s\n", "ID", "Name", "Price", "Stock", "Value");
+    report_printf("--------------------------------------------------\n");
+    for (int i = 0; i < item_count; i++) {
+        report_printf("%-5d %-20s $%-9s %-8d $%-11s\n",
+                      items[i].id,
+                      items[i].name,
+                      money_format(item_price_column[i], price),
+                      item_stock_column[i],
+                      money_format(item_price_column[i] * item_stock_column[i], value));
+    }
+    report_printf("--------------------------------------------------\n");
+    report_printf("SKUs: %d   Units in stock: %ld\n", item_count, totals.total_units);
+    report_printf("Total Stock Value: $%s\n", money_format(totals.total_value, value));
+
+    report_printf("--------------------------------------------------\n");
+    report_printf("Items below %d units: %d\n", low_stock_threshold, totals.low_stock_count);
+    if (totals.low_stock_count > 0) {
+        for (int i = 0; i < item_count; i++) {
+            if (item_stock_column[i] < low_stock_threshold) {
+                report_printf("  %-5d %-20s %d left\n", items[i].id, items[i].name, item_stock_column[i]);
+            }
+        }
+    }
+    report_printf("==================================================\n");
+    report_cache_end();
+}
+
+// Market basket analysis
+#define BASKET_TOP_PAIRS 10
+#define BASKET_MIN_SUPPORT 2        // pairs bought together fewer times are dropped
+#define BASKET_PAIR_LIMIT (1 << 18) // live pair entries per table before pruning
+#define BASKET_MAX_LINES 256        // larger (wholesale) baskets skip pair counting
+#define BASKET_MIN_CHUNK 4096       // detail lines per worker thread
+
+typedef struct {
+    int start;
+    int end;
+    int baskets;
+    int prune_floor;   // pair counts at or below this may have been pruned
+    IntMap pairs;      // (item_a << 32 | item_b) -> receipts containing both
+    IntMap singles;    // item_id -> receipts containing it
+    int failed;        // set if the worker ran out of memory
+} BasketChunk;
+
+typedef struct {
+    int item_a;
+    int item_b;
+    int64_t together;
+    double lift;
+} BasketPair;
+
+static uint64_t basket_pair_key(int a, int b) {
+    return ((uint64_t)(uint32_t)a << 32) | (uint32_t)b;
+}
+
+static int compare_int(const void* a, const void* b) {
+    int x = *(const int*)a;
+    int y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+
+// Lossy-counting prune: raise the floor until the table is half empty
+static void basket_prune(IntMap* pairs, int* floor) {
+    while (pairs->count > BASKET_PAIR_LIMIT / 2) {
+        (*floor)++;
+        IntMap kept;
+        intmap_init(&kept, pairs->count);
+        for (size_t i = 0; i < pairs->capacity; i++) {
+            if (pairs->used[i] && pairs->values[i] > *floor) {
+                intmap_put(&kept, pairs->keys[i], pairs->values[i]);
+            }
+        }
+        intmap_free(pairs);
+        *pairs = kept;
+    }
+}
+
+static void basket_count_receipt(BasketChunk* chunk, int* ids, int n) {
+    qsort(ids, n, sizeof(int), compare_int);
+
+    int distinct = 0;
+    for (int i = 0; i < n; i++) {
+        if (distinct == 0 || ids[distinct - 1] != ids[i]) {
+            ids[distinct++] = ids[i];
+        }
+    }
+
+    chunk->baskets++;
+    for (int i = 0; i < distinct; i++) {
+        (*intmap_upsert(&chunk->singles, (uint32_t)ids[i], NULL))++;
+    }
+    if (distinct > BASKET_MAX_LINES) {
+        return;
+    }
+    for (int i = 0; i < distinct; i++) {
+        for (int j = i + 1; j < distinct; j++) {
+            (*intmap_upsert(&chunk->pairs, basket_pair_key(ids[i], ids[j]), NULL))++;
+        }
+        if (chunk->pairs.count > BASKET_PAIR_LIMIT) {
+            basket_prune(&chunk->pairs, &chunk->prune_floor);
+        }
+    }
+}
+
+static void basket_count_chunk(void* arg) {
+    BasketChunk* chunk = arg;
+    int capacity = 64;
+    int* ids = malloc(capacity * sizeof(int));
+    int n = 0;
+    if (ids == NULL) {
+        printf("Error: Out of memory counting baskets.\n");
+        chunk->failed = 1;
+        return;
+    }
+
+    for (int i = chunk->start; i < chunk->end; i++) {
+        if (n > 0 && strcmp(receipt_details[i].receipt_id, receipt_details[i - 1].receipt_id) != 0) {
+            basket_count_receipt(chunk, ids, n);
+            n = 0;
+        }
+        if (receipt_details[i].quantity <= 0) {
+            continue;                   // a refund line, not part of a basket
+        }
+        if (n == capacity) {
+            int* grown = realloc(ids, capacity * 2 * sizeof(int));
+            if (grown == NULL) {
+                printf("Error: Out of memory counting baskets.\n");
+                chunk->failed = 1;
+                free(ids);
+                return;
+            }
+            ids = grown;
+            capacity *= 2;
+        }
+        ids[n++] = receipt_details[i].item_id;
+    }
+    if (n > 0) {
+        basket_count_receipt(chunk, ids, n);
+    }
+    free(ids);
+}
+
+static const char* basket_item_name(int item_id) {
+    Item* item = find_item_by_id(item_id);
+    return item ? item->name : "(unknown)";
+}
+
+// Counts item pairs across all receipts and keeps the top pairs by
+// co-occurrence count, then lift. Returns the number of pairs in top, or
+// -1 if a worker could not finish.
+static int compute_basket_pairs(BasketPair* top, int* baskets, int* prune_floor) {
+    // Split the detail lines into chunks that never cut a receipt in two
+    int workers = receipt_detail_count / BASKET_MIN_CHUNK;
+    if (workers > worker_count()) workers = worker_count();
+    if (workers < 1) workers = 1;
+
+    BasketChunk chunks[MAX_WORKERS];
+    int boundary = 0;
+    for (int w = 0; w < workers; w++) {
+        chunks[w].start = boundary;
+        boundary = (int)((long long)receipt_detail_count * (w + 1) / workers);
+        while (boundary > 0 && boundary < receipt_detail_count &&
+               strcmp(receipt_details[boundary].receipt_id, receipt_details[boundary - 1].receipt_id) == 0) {
+            boundary++;
+        }
+        if (boundary < chunks[w].start) boundary = chunks[w].start;
+        chunks[w].end = boundary;
+        chunks[w].baskets = 0;
+        chunks[w].prune_floor = 0;
+        chunks[w].failed = 0;
+        intmap_init(&chunks[w].pairs, 1024);
+        intmap_init(&chunks[w].singles, 256);
+    }
+
+    parallel_run(workers, basket_count_chunk, chunks, sizeof(BasketChunk));
+
+    int failed = 0;
+    for (int w = 0; w < workers; w++) {
+        failed |= chunks[w].failed;
+    }
+    if (failed) {
+        for (int w = 0; w < workers; w++) {
+            intmap_free(&chunks[w].pairs);
+            intmap_free(&chunks[w].singles);
+        }
+        *baskets = 0;
+        *prune_floor = 0;
+        return -1;
+    }
+
+    // Merge worker tables into the first one
+    BasketChunk* total = &chunks[0];
+    for (int w = 1; w < workers; w++) {
+        BasketChunk* part = &chunks[w];
+        total->baskets += part->baskets;
+        total->prune_floor += part->prune_floor;
+        for (size_t i = 0; i < part->singles.capacity; i++) {
+            if (part->singles.used[i]) {
+                *intmap_upsert(&total->singles, part->singles.keys[i], NULL) += part->singles.values[i];
+            }
+        }
+        for (size_t i = 0; i < part->pairs.capacity; i++) {
+            if (part->pairs.used[i]) {
+                *intmap_upsert(&total->pairs, part->pairs.keys[i], NULL) += part->pairs.values[i];
+            }
+        }
+        if (total->pairs.count > BASKET_PAIR_LIMIT) {
+            basket_prune(&total->pairs, &total->prune_floor);
+        }
+        intmap_free(&part->pairs);
+        intmap_free(&part->singles);
+    }
+
+    int top_count = 0;
+    for (size_t i = 0; i < total->pairs.capacity; i++) {
+        if (!total->pairs.used[i] || total->pairs.values[i] < BASKET_MIN_SUPPORT) {
+            continue;
+        }
+        BasketPair pair;
+        pair.item_a = (int)(uint32_t)(total->pairs.keys[i] >> 32);
+        pair.item_b = (int)(uint32_t)total->pairs.keys[i];
+        pair.together = total->pairs.values[i];
+        int64_t count_a = *intmap_get(&total->singles, (uint32_t)pair.item_a);
+        int64_t count_b = *intmap_get(&total->singles, (uint32_t)pair.item_b);
+        pair.lift = (double)pair.together * total->baskets / ((double)count_a * count_b);
+
+        int pos = top_count;
+        while (pos > 0 && (top[pos - 1].together < pair.together ||
+               (top[pos - 1].together == pair.together && top[pos - 1].lift < pair.lift))) {
+            pos--;
+        }
+        if (pos >= BASKET_TOP_PAIRS) {
+            continue;
+        }
+        int last = top_count < BASKET_TOP_PAIRS ? top_count : BASKET_TOP_PAIRS - 1;
+        memmove(&top[pos + 1], &top[pos], (last - pos) * sizeof(BasketPair));
+        top[pos] = pair;
+        if (top_count < BASKET_TOP_PAIRS) top_count++;
+    }
+
+    *baskets = total->baskets;
+    *prune_floor = total->prune_floor;
+    intmap_free(&total->pairs);
+    intmap_free(&total->singles);
+    return top_count;
+}
+
+void market_basket_report() {
+    ReportParams params = {"", "", 0, 0, 0};
+    if (report_cache_begin(REPORT_MARKET_BASKET, &params)) {
+        return;
+    }
+
+    report_printf("\n==================================================\n");
+    report_printf("          ITEM CO-OCCURRENCE (MARKET BASKET)\n");
+    report_printf("==================================================\n");
+
+    if (receipt_detail_count == 0) {
+        report_printf("No sales data available.\n");
+        report_cache_end();
+        return;
+    }
+
+    BasketPair top[BASKET_TOP_PAIRS];
+    int baskets, prune_floor;
+    int top_count = compute_basket_pairs(top, &baskets, &prune_floor);
+    if (top_count < 0) {
+        printf("Items bought together could not be computed.\n");
+        report_cache_abandon();
+        return;
+    }
+
+    report_printf("Receipts analysed: %d\n", baskets);
+    report_printf("--------------------------------------------------\n");
+
+    if (top_count == 0) {
+        report_printf("No item pairs bought together at least %d times.\n", BASKET_MIN_SUPPORT);
+    } else {
+        report_printf("%-16s %-16s %-6s %-8s %-6s\n", "Item A", "Item B", "Count", "Support", "Lift");
+        report_printf("--------------------------------------------------\n");
+        for (int i = 0; i < top_count; i++) {
+            report_printf("%-16.16s %-16.16s %-6lld %6.2f%%  %-6.2f\n",
+                          basket_item_name(top[i].item_a),
+                          basket_item_name(top[i].item_b),
+                          (long long)top[i].together,
+                          100.0 * top[i].together / baskets,
+                          top[i].lift);
+        }
+    }
+    if (prune_floor > 0) {
+        report_printf("(Rare pairs pruned; counts may be low by up to %d)\n", prune_floor);
+    }
+    report_printf("==================================================\n");
+    report_cache_end();
+}
+
+// Report exports. Each writes the same rows its on-screen report shows,
+// streamed through an Exporter instead of printf.
+
+static void export_daily_sales(Exporter* out, const char* date) {
+    static const char* const columns[] = {"receipt_id", "customer_id", "date", "amount"};
+    export_columns(out, columns, 4);
+    for (int i = 0; i < receipt_count; i++) {
+        if (strcmp(receipts[i].date, date) == 0) {
+            export_row_begin(out);
+            export_str(out, receipts[i].receipt_id);
+            export_int(out, receipts[i].customer_id);
+            export_str(out, receipts[i].date);
+            export_money(out, receipts[i].total_amount);
+            export_row_end(out);
+        }
+    }
+}
+
+static void export_customer_history(Exporter* out, int customer_id) {
+    static const char* const columns[] = {"receipt_id", "date", "item_id", "item_name", "quantity", "price", "total"};
+    export_columns(out, columns, 7);
+
+    // One pass over the details, matched to this customer's receipts by number
+    IntMap owned;
+    intmap_init(&owned, 64);
+    for (int i = 0; i < receipt_count; i++) {
+        int num;
+        if (receipts[i].customer_id == customer_id && sscanf(receipts[i].receipt_id, "R%d", &num) == 1) {
+            intmap_put(&owned, (uint32_t)num, i);
+        }
+    }
+    for (int i = 0; i < receipt_detail_count && owned.count > 0; i++) {
+        int num;
+        int64_t* index;
+        if (sscanf(receipt_details[i].receipt_id, "R%d", &num) != 1 ||
+            (index = intmap_get(&owned, (uint32_t)num)) == NULL) {
+            continue;
+        }
+        export_row_begin(out);
+        export_str(out, receipt_details[i].receipt_id);
+        export_str(out, receipts[*index].date);
+        export_int(out, receipt_details[i].item_id);
+        export_str(out, receipt_details[i].item_name);
+        export_int(out, receipt_details[i].quantity);
+        export_money(out, receipt_details[i].price);
+        export_money(out, receipt_details[i].total);
+        export_row_end(out);
+    }
+    intmap_free(&owned);
+}
+
+static void export_item_sales(Exporter* out) {
+    static const char* const columns[] = {"item_id", "item_name", "quantity_sold", "revenue"};
+    export_columns(out, columns, 4);
+    ItemStats stats[MAX_ITEMS];
+    int stat_count = collect_item_stats(stats);
+    for (int i = 0; i < stat_count; i++) {
+        export_row_begin(out);
+        export_int(out, stats[i].item_id);
+        export_str(out, stats[i].item_name);
+        export_int(out, stats[i].quantity_sold);
+        export_money(out, stats[i].total_revenue);
+        export_row_end(out);
+    }
+}
+
+static void export_market_basket(Exporter* out) {
+    static const char* const columns[] = {"item_a", "item_b", "count", "support", "lift"};
+    export_columns(out, columns, 5);
+    if (receipt_detail_count == 0) {
+        return;
+    }
+    BasketPair top[BASKET_TOP_PAIRS];
+    int baskets, prune_floor;
+    int top_count = compute_basket_pairs(top, &baskets, &prune_floor);
+    for (int i = 0; i < top_count; i++) {
+        export_row_begin(out);
+        export_int(out, top[i].item_a);
+        export_int(out, top[i].item_b);
+        export_int(out, top[i].together);
+        export_fixed(out, (double)top[i].together / baskets, 4);
+        export_fixed(out, top[i].lift, 4);
+        export_row_end(out);
+    }
+}
+
+static void export_distinct_customers(Exporter* out, const ReportParams* params) {
+    static const char* const columns[] = {"from_date", "to_date", "item_id", "days", "customers", "std_error"};
+    export_columns(out, columns, 6);
+    HyperLogLog merged;
+    int days = analytics_distinct_customers(date_key(params->from_date), date_key(params->to_date),
+                                            params->item_id, &merged);
+    export_row_begin(out);
+    export_str(out, params->from_date);
+    export_str(out, params->to_date);
+    export_int(out, params->item_id);
+    export_int(out, days);
+    export_int(out, days ? (long long)(hll_estimate(&merged) + 0.5) : 0);
+    export_fixed(out, hll_standard_error(), 4);
+    export_row_end(out);
+}
+
+static void export_basket_value(Exporter* out, const ReportParams* params) {
+    static const char* const columns[] = {"from_date", "to_date", "transactions", "min", "p50", "p90", "p99", "max"};
+    export_columns(out, columns, 8);
+    TDigest amounts;
+    analytics_amount_distribution(date_key(params->from_date), date_key(params->to_date), &amounts);
+    export_row_begin(out);
+    export_str(out, params->from_date);
+    export_str(out, params->to_date);
+    export_int(out, (long long)amounts.total_weight);
+    export_money(out, money_from_double(amounts.min));
+    export_money(out, money_from_double(tdigest_quantile(&amounts, 0.50)));
+    export_money(out, money_from_double(tdigest_quantile(&amounts, 0.90)));
+    export_money(out, money_from_double(tdigest_quantile(&amounts, 0.99)));
+    export_money(out, money_from_double(amounts.max));
+    export_row_end(out);
+}
+
+static void export_hourly_heatmap(Exporter* out) {
+    static const char* const columns[] = {"weekday", "hour", "transactions", "sales"};
+    export_columns(out, columns, 4);
+    const HourBucket (*heatmap)[24] = analytics_hourly_heatmap();
+    for (int d = 0; d < 7; d++) {
+        for (int h = 0; h < 24; h++) {
+            export_row_begin(out);
+            export_int(out, d);
+            export_int(out, h);
+            export_int(out, heatmap[d][h].transactions);
+            export_money(out, heatmap[d][h].sales);
+            export_row_end(out);
+        }
+    }
+}
+
+static void export_inventory(Exporter* out, int threshold) {
+    static const char* const columns[] = {"item_id", "name", "price", "stock", "value", "low_stock"};
+    export_columns(out, columns, 6);
+    for (int i = 0; i < item_count; i++) {
+        export_row_begin(out);
+        export_int(out, items[i].id);
+        export_str(out, items[i].name);
+        export_money(out, item_price_column[i]);
+        export_int(out, item_stock_column[i]);
+        export_money(out, item_price_column[i] * item_stock_column[i]);
+        export_int(out, item_stock_column[i] < threshold);
+        export_row_end(out);
+    }
+}
+
+static void export_receipt_history(Exporter* out) {
+    static const char* const columns[] = {"receipt_id", "customer_id", "date", "amount", "timestamp",
+                                          "discount", "tax", "refund_of"};
+    export_columns(out, columns, 8);
+    for (int i = 0; i < receipt_count; i++) {
+        export_row_begin(out);
+        export_str(out, receipts[i].receipt_id);
+        export_int(out, receipts[i].customer_id);
+        export_str(out, receipts[i].date);
+        export_money(out, receipts[i].total_amount);
+        export_int(out, receipts[i].timestamp);
+        export_money(out, receipts[i].discount_amount);
+        export_money(out, receipts[i].tax_amount);
+        export_str(out, receipts[i].refund_of);
+        export_row_end(out);
+    }
+}
+
+static void export_item_history(Exporter* out) {
+    static const char* const columns[] = {"receipt_id", "item_id", "item_name", "quantity", "price", "total"};
+    export_columns(out, columns, 6);
+    for (int i = 0; i < receipt_detail_count; i++) {
+        export_row_begin(out);
+        export_str(out, receipt_details[i].receipt_id);
+        export_int(out, receipt_details[i].item_id);
+        export_str(out, receipt_details[i].item_name);
+        export_int(out, receipt_details[i].quantity);
+        export_money(out, receipt_details[i].price);
+        export_money(out, receipt_details[i].total);
+        export_row_end(out);
+    }
+}
+
+// Writes one report to path. Returns the number of rows written, or -1.
+static void write_report(Exporter* out, ReportType type, const ReportParams* params) {
+    switch (type) {
+        case REPORT_DAILY_SALES:        export_daily_sales(out, params->from_date); break;
+        case REPORT_CUSTOMER_HISTORY:   export_customer_history(out, params->customer_id); break;
+        case REPORT_ITEM_SALES:         export_item_sales(out); break;
+        case REPORT_MARKET_BASKET:      export_market_basket(out); break;
+        case REPORT_DISTINCT_CUSTOMERS: export_distinct_customers(out, params); break;
+        case REPORT_BASKET_VALUE:       export_basket_value(out, params); break;
+        case REPORT_HOURLY_HEATMAP:     export_hourly_heatmap(out); break;
+        case REPORT_RECEIPT_HISTORY:    export_receipt_history(out); break;
+        case REPORT_ITEM_HISTORY:       export_item_history(out); break;
+        case REPORT_INVENTORY:          export_inventory(out, params->threshold); break;
+    }
+}
+
+int export_report(ReportType type, const ReportParams* params, ExportFormat format, const char* path) {
+    Exporter out;
+    if (!export_open(&out, path, format)) {
+        return -1;
+    }
+    write_report(&out, type, params);
+    long rows = out.rows;
+    return export_close(&out) ? (int)rows : -1;
+}
+
+// As export_report(), onto a stream that stays open
+int export_report_to(ReportType type, const ReportParams* params, ExportFormat format, FILE* file) {
+    Exporter out;
+    if (!export_attach(&out, file, format)) {
+        return -1;
+    }
+    write_report(&out, type, params);
+    long rows = out.rows;
+    return export_close(&out) ? (int)rows : -1;
+}
+
+// Latest data version a report's output depends on
+unsigned long report_changed_at(ReportType type, const ReportParams* params) {
+    unsigned long receipts_at = data_changed_at(DATA_RECEIPTS, 0);
+    unsigned long items_at = data_changed_at(DATA_ITEMS, 0);
+    unsigned long stock_at = data_changed_at(DATA_ITEM_STOCK, 0);
+
+    switch (type) {
+        case REPORT_DAILY_SALES:
+            return data_changed_at(DATA_RECEIPTS_BY_DAY, date_key(params->from_date));
+        case REPORT_CUSTOMER_HISTORY:
+            return data_changed_at(DATA_RECEIPTS_BY_CUSTOMER, params->customer_id);
+        case REPORT_MARKET_BASKET:
+        case REPORT_DISTINCT_CUSTOMERS:
+            // These also print item names from the catalog
+            return receipts_at > items_at ? receipts_at : items_at;
+        case REPORT_INVENTORY:
+            return stock_at > items_at ? stock_at : items_at;
+        default:
+            return receipts_at;
+    }
+}
+
+// RFM (recency / frequency / monetary) customer segmentation
+#define RFM_MIN_CHUNK 4096          // receipts per worker thread
+
+typedef struct {
+    int last_day;                   // days since 1970-01-01 of the latest purchase
+    int frequency;
+    money_t monetary;
+} RfmTotals;
+
+typedef struct {
+    int start;
+    int end;
+    IntMap index;                   // customer_id -> slot in totals
+    RfmTotals* totals;
+    int count;
+    int capacity;
+    int failed;                     // set if the worker ran out of memory
+} RfmChunk;
+
+// Days since 1970-01-01 for a YYYYMMDD key (proleptic Gregorian)
+static int day_number(int key) {
+    int y = key / 10000, m = key / 100 % 100, d = key % 100;
+    y -= m <= 2;
+    int era = (y >= 0 ? y : y - 399) / 400;
+    int yoe = y - era * 400;
+    int doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+// The customer's totals in chunk, added if new. Returns NULL, with
+// chunk->failed set, if there is no memory for another customer.
+static RfmTotals* rfm_slot(RfmChunk* chunk, int customer_id) {
+    int inserted;
+    int64_t* slot = intmap_upsert(&chunk->index, (uint32_t)customer_id, &inserted);
+    if (inserted) {
+        if (chunk->count == chunk->capacity) {
+            int capacity = chunk->capacity ? chunk->capacity * 2 : 64;
+            RfmTotals* grown = realloc(chunk->totals, capacity * sizeof(RfmTotals));
+            if (grown == NULL) {
+                printf("Error: Out of memory segmenting customers.\n");
+                chunk->failed = 1;
+                return NULL;
+            }
+            chunk->totals = grown;
+            chunk->capacity = capacity;
+        }
+        *slot = chunk->count;
+        chunk->totals[chunk->count].last_day = 0;
+        chunk->totals[chunk->count].frequency = 0;
+        chunk->totals[chunk->count].monetary = 0;
+        chunk->count++;
+    }
+    return &chunk->totals[*slot];
+}
+
+static void rfm_count_chunk(void* arg) {
+    RfmChunk* chunk = arg;
+    for (int i = chunk->start; i < chunk->end; i++) {
+        RfmTotals* totals = rfm_slot(chunk, receipts[i].customer_id);
+        if (totals == NULL) {
+            return;
+        }
+        totals->monetary += receipts[i].total_amount;
+        if (receipts[i].refund_of[0] != '\0') {
+            continue;                   // a return is not a visit
+        }
+        int day = day_number(date_key(receipts[i].date));
+        if (day > totals->last_day) totals->last_day = day;
+        totals->frequency++;
+    }
+}
+
+// Quickselect: partially orders v so that v[k] holds the k-th smallest
+// value, with nothing larger before it and nothing smaller after it
+static double select_nth(double* v, int lo, int hi, int k) {
+    while (hi - lo > 1) {
+        int mid = lo + (hi - lo) / 2;
+        double a = v[lo], b = v[mid], c = v[hi - 1];
+        double pivot = a < b ? (b < c ? b : (a < c ? c : a)) : (a < c ? a : (b < c ? c : b));
+        int i = lo, j = hi - 1;
+        while (i <= j) {
+            while (v[i] < pivot) i++;
+            while (v[j] > pivot) j--;
+            if (i <= j) {
+                double t = v[i]; v[i] = v[j]; v[j] = t;
+                i++;
+                j--;
+            }
+        }
+        if (k <= j) {
+            hi = j + 1;
+        } else if (k >= i) {
+            lo = i;
+        } else {
+            break;
+        }
+    }
+    return v[k];
+}
+
+// Fills cuts[0..3] with the 20/40/60/80% quintile boundaries of v
+static void quintile_cuts(double* v, int n, double* cuts) {
+    int lo = 0;
+    for (int q = 1; q <= 4; q++) {
+        int k = (int)((long long)n * q / 5);
+        if (k >= n) k = n - 1;
+        cuts[q - 1] = select_nth(v, lo, n, k);
+        lo = k;
+    }
+}
+
+// 1..5; one point for every quintile boundary the value beats
+static int quintile_score(double value, const double* cuts, int higher_is_better) {
+    int score = 1;
+    for (int i = 0; i < 4; i++) {
+        if (higher_is_better ? value > cuts[i] : value < cuts[i]) {
+            score++;
+        }
+    }
+    return score;
+}
+
+static const char* rfm_segment(int r, int f) {
+    if (r >= 4 && f >= 4) return "Champions";
+    if (f >= 4) return "Loyal";
+    if (r >= 4 && f <= 2) return "New";
+    if (r <= 2 && f >= 3) return "At Risk";
+    if (r <= 2) return "Hibernating";
+    return "Potential";
+}
+
+void rfm_segmentation_report(const char* path) {
+    static const char* segment_names[] = {"Champions", "Loyal", "New", "At Risk", "Hibernating", "Potential", "No Purchases"};
+    static const char* const columns[] = {"customer_id", "name", "recency_days", "frequency", "monetary",
+                                          "r", "f", "m", "segment"};
+
+    printf("\n==================================================\n");
+    printf("             RFM CUSTOMER SEGMENTATION\n");
+    printf("==================================================\n");
+
+    // One pass over the receipts, split across workers
+    int workers = receipt_count / RFM_MIN_CHUNK;
+    if (workers > worker_count()) workers = worker_count();
+    if (workers < 1) workers = 1;
+
+    RfmChunk chunks[MAX_WORKERS];
+    memset(chunks, 0, sizeof(chunks));
+    for (int w = 0; w < workers; w++) {
+        chunks[w].start = (int)((long long)receipt_count * w / workers);
+        chunks[w].end = (int)((long long)receipt_count * (w + 1) / workers);
+        intmap_init(&chunks[w].index, 256);
+    }
+    parallel_run(workers, rfm_count_chunk, chunks, sizeof(RfmChunk));
+
+    int failed = 0;
+    for (int w = 0; w < workers; w++) {
+        failed |= chunks[w].failed;
+    }
+
+    RfmChunk* total = &chunks[0];
+    for (int w = 1; w < workers; w++) {
+        for (size_t i = 0; i < chunks[w].index.capacity && !failed; i++) {
+            if (!chunks[w].index.used[i]) continue;
+            RfmTotals* part = &chunks[w].totals[chunks[w].index.values[i]];
+            RfmTotals* merged = rfm_slot(total, (int)chunks[w].index.keys[i]);
+            if (merged == NULL) {
+                failed = 1;
+                break;
+            }
+            if (part->last_day > merged->last_day) merged->last_day = part->last_day;
+            merged->frequency += part->frequency;
+            merged->monetary += part->monetary;
+        }
+        intmap_free(&chunks[w].index);
+        free(chunks[w].totals);
+    }
+
+    double* values = NULL;
+    if (!failed && total->count > 0) {
+        values = malloc(total->count * sizeof(double));
+        if (values == NULL) {
+            printf("Error: Out of memory segmenting customers.\n");
+            failed = 1;
+        }
+    }
+    if (failed) {
+        printf("Customer segments could not be computed.\n");
+        report_cache_abandon();
+        intmap_free(&total->index);
+        free(total->totals);
+        return;
+    }
+
+    // Recency is measured from the latest sale in the data set
+    int reference_day = 0;
+    for (int i = 0; i < total->count; i++) {
+        if (total->totals[i].last_day > reference_day) reference_day = total->totals[i].last_day;
+    }
+
+    double cuts[3][4] = {{0}};
+    if (total->count > 0) {
+        for (int metric = 0; metric < 3; metric++) {
+            for (int i = 0; i < total->count; i++) {
+                RfmTotals* t = &total->totals[i];
+                values[i] = metric == 0 ? reference_day - t->last_day :
+                            metric == 1 ? t->frequency : (double)t->monetary;
+            }
+            quintile_cuts(values, total->count, cuts[metric]);
+        }
+        free(values);
+    }
+
+    Exporter out;
+    if (!export_open(&out, path, EXPORT_CSV)) {
+        intmap_free(&total->index);
+        free(total->totals);
+        return;
+    }
+    export_columns(&out, columns, 9);
+
+    int segment_counts[7] = {0};
+    for (int c = 0; c < customer_count; c++) {
+        int64_t* slot = intmap_get(&total->index, (uint32_t)customers[c].id);
+        export_row_begin(&out);
+        export_int(&out, customers[c].id);
+        export_str(&out, customers[c].name);
+        if (slot == NULL) {
+            export_str(&out, "");
+            export_int(&out, 0);
+            export_money(&out, 0);
+            export_int(&out, 0);
+            export_int(&out, 0);
+            export_int(&out, 0);
+            export_str(&out, segment_names[6]);
+            segment_counts[6]++;
+        } else {
+            RfmTotals* t = &total->totals[*slot];
+            int recency = reference_day - t->last_day;
+            int r = quintile_score(recency, cuts[0], 0);
+            int f = quintile_score(t->frequency, cuts[1], 1);
+            int m = quintile_score((double)t->monetary, cuts[2], 1);
+            const char* segment = rfm_segment(r, f);
+            export_int(&out, recency);
+            export_int(&out, t->frequency);
+            export_money(&out, t->monetary);
+            export_int(&out, r);
+            export_int(&out, f);
+            export_int(&out, m);
+            export_str(&out, segment);
+            for (int s = 0; s < 6; s++) {
+                if (strcmp(segment, segment_names[s]) == 0) segment_counts[s]++;
+            }
+        }
+        export_row_end(&out);
+    }
+    int ok = export_close(&out);
+
+    printf("Customers with purchases: %d of %d\n", total->count, customer_count);
+    printf("--------------------------------------------------\n");
+    printf("%-20s %-10s\n", "Segment", "Customers");
+    printf("--------------------------------------------------\n");
+    for (int s = 0; s < 7; s++) {
+        printf("%-20s %-10d\n", segment_names[s], segment_counts[s]);
+    }
     printf("--------------------------------------------------\n");
-    printf("Total Items Sold: %d\n", total_quantity);
-    printf("Total Revenue: $%.2f\n", total_revenue);
+    if (ok) {
+        printf("Segments written to %s\n", path);
+    }
     printf("==================================================\n");
-}
\ No newline at end of file
+
+    intmap_free(&total->index);
+    free(total->totals);
+}
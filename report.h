@@ -1,18 +1,24 @@
 #ifndef REPORT_H
 #define REPORT_H
 
+#include <stdint.h>
 #include "customer.h"
 #include "item.h"
+#include "export.h"
+#include "pricing.h"
+#include "lane.h"
 
 #define MAX_DATE_LEN 15
-#define MAX_RECEIPTS 1000
-#define MAX_RECEIPT_DETAILS 5000
 
 typedef struct {
     char receipt_id[10];
     int customer_id;
     char date[MAX_DATE_LEN];
-    float total_amount;
+    money_t total_amount;     // amount paid, after discount and tax
+    int64_t timestamp;        // seconds since the epoch, 0 if unknown
+    money_t discount_amount;
+    money_t tax_amount;
+    char refund_of[10];       // receipt_id of the sale a refund reverses; "" for a sale
 } Receipt;
 
 typedef struct {
@@ -20,25 +26,73 @@ typedef struct {
     int item_id;
     char item_name[MAX_NAME_LEN];
     int quantity;
-    float price;
-    float total;
+    money_t price;
+    money_t total;
+    money_t discount;         // promotion and tier discount on the line
 } ReceiptDetail;
 
+// Line discount of a row written before discounts were kept per line,
+// until load_receipts() shares out its receipt's discount
+#define DISCOUNT_UNKNOWN INT64_MIN
+
+// One item being returned, by units
+typedef struct {
+    int item_id;
+    int quantity;
+} ReturnLine;
+
+typedef enum {
+    REPORT_DAILY_SALES = 1,
+    REPORT_CUSTOMER_HISTORY,
+    REPORT_ITEM_SALES,
+    REPORT_MARKET_BASKET,
+    REPORT_DISTINCT_CUSTOMERS,
+    REPORT_BASKET_VALUE,
+    REPORT_HOURLY_HEATMAP,
+    REPORT_RECEIPT_HISTORY,
+    REPORT_ITEM_HISTORY,
+    REPORT_INVENTORY
+} ReportType;
+
+// Inputs a report may use; unused fields are ignored
+typedef struct {
+    char from_date[MAX_DATE_LEN];
+    char to_date[MAX_DATE_LEN];
+    int customer_id;
+    int item_id;
+    int threshold;            // low-stock limit for the inventory report
+} ReportParams;
+
 // Function prototypes
 void load_receipts();
-void save_receipts();
-char* generate_receipt(Customer* customer);
-void display_receipt(Customer* customer, const char* receipt_id, float total);
+int save_receipts();
+int checkpoint_store();
+int generate_receipt(Lane* lane, Receipt* receipt, int print);
+void display_receipt(const Receipt* receipt, const Customer* customer, const Cart* cart,
+                     const PricingResult* pricing);
+int show_returnable_lines(const char* receipt_id);
+int refund_receipt(const char* receipt_id, const ReturnLine* returns, int return_count,
+                   Receipt* refund, int print);
 void daily_sales_report(const char* date);
 void customer_purchase_history(int customer_id);
 void item_sales_summary();
+void market_basket_report();
+void distinct_customers_report(const char* from_date, const char* to_date, int item_id);
+void basket_value_report(const char* from_date, const char* to_date);
+void hourly_heatmap_report();
+void rfm_segmentation_report(const char* path);
+void inventory_report(int low_stock_threshold);
+int export_report(ReportType type, const ReportParams* params, ExportFormat format, const char* path);
+int export_report_to(ReportType type, const ReportParams* params, ExportFormat format, FILE* file);
 char* get_next_receipt_id();
 void get_current_date(char* date_str);
 void get_current_time(char* time_str);
 
 // Global variables
-extern Receipt receipts[MAX_RECEIPTS];
-extern ReceiptDetail receipt_details[MAX_RECEIPT_DETAILS];
+// Growable; reallocated as receipts are added, so do not hold pointers
+// into them across a checkout
+extern Receipt* receipts;
+extern ReceiptDetail* receipt_details;
 extern int receipt_count;
 extern int receipt_detail_count;
 
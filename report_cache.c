@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include "report_cache.h"
+#include "data_version.h"
+
+typedef struct {
+    int in_use;
+    ReportType type;
+    ReportParams params;
+    unsigned long version;       // data_version() when the output was built
+    unsigned long last_used;
+    char* output;
+    size_t length;
+} CacheEntry;
+
+static CacheEntry cache[REPORT_CACHE_SLOTS];
+static unsigned long use_clock = 0;
+
+// Capture state for the report currently being rendered
+static CacheEntry* capturing = NULL;
+static char* capture_buffer = NULL;
+static size_t capture_length = 0;
+static size_t capture_capacity = 0;
+
+static int same_params(const ReportParams* a, const ReportParams* b) {
+    return strcmp(a->from_date, b->from_date) == 0 &&
+           strcmp(a->to_date, b->to_date) == 0 &&
+           a->customer_id == b->customer_id &&
+           a->item_id == b->item_id &&
+           a->threshold == b->threshold;
+}
+
+int report_cache_begin(ReportType type, const ReportParams* params) {
+    CacheEntry* victim = &cache[0];
+    for (int i = 0; i < REPORT_CACHE_SLOTS; i++) {
+        CacheEntry* entry = &cache[i];
+        if (entry->in_use && entry->type == type && same_params(&entry->params, params)) {
+            if (entry->version >= report_changed_at(type, params)) {
+                entry->last_used = ++use_clock;
+                fwrite(entry->output, 1, entry->length, stdout);
+                return 1;
+            }
+            victim = entry;      // stale: rebuild in place
+            break;
+        }
+        if (!entry->in_use || (victim->in_use && entry->last_used < victim->last_used)) {
+            victim = entry;
+        }
+    }
+
+    free(victim->output);
+    victim->in_use = 0;
+    victim->output = NULL;
+    victim->type = type;
+    victim->params = *params;
+    victim->version = data_version();
+
+    capturing = victim;
+    capture_length = 0;
+    return 0;
+}
+
+void report_cache_end() {
+    if (capturing == NULL) {
+        return;
+    }
+    if (capture_length <= REPORT_CACHE_MAX_OUTPUT) {
+        capturing->output = malloc(capture_length ? capture_length : 1);
+        if (capturing->output != NULL) {
+            memcpy(capturing->output, capture_buffer, capture_length);
+            capturing->length = capture_length;
+            capturing->last_used = ++use_clock;
+            capturing->in_use = 1;
+        }
+    }
+    capturing = NULL;
+}
+
+// Drops the report being captured, for one that failed part-way
+void report_cache_abandon() {
+    capturing = NULL;
+}
+
+void report_printf(const char* format, ...) {
+    char line[512];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    if (length < 0) {
+        return;
+    }
+    if ((size_t)length >= sizeof(line)) {
+        length = sizeof(line) - 1;
+    }
+    fwrite(line, 1, length, stdout);
+
+    // Outputs too large to be worth caching are simply not captured
+    if (capturing == NULL || capture_length + length > REPORT_CACHE_MAX_OUTPUT) {
+        capture_length = REPORT_CACHE_MAX_OUTPUT + 1;
+        return;
+    }
+    if (capture_length + length > capture_capacity) {
+        size_t capacity = capture_capacity ? capture_capacity : 4096;
+        while (capacity < capture_length + length) {
+            capacity *= 2;
+        }
+        char* grown = realloc(capture_buffer, capacity);
+        if (grown == NULL) {
+            capture_length = REPORT_CACHE_MAX_OUTPUT + 1;
+            return;
+        }
+        capture_buffer = grown;
+        capture_capacity = capacity;
+    }
+    memcpy(capture_buffer + capture_length, line, length);
+    capture_length += length;
+}
@@ -0,0 +1,21 @@
+#ifndef REPORT_CACHE_H
+#define REPORT_CACHE_H
+
+#include "report.h"
+
+// Rendered-output cache for reports. A report calls report_cache_begin()
+// first; if an entry for the same type and parameters is still current,
+// its text is replayed and the report returns. Otherwise the report
+// prints through report_printf(), which also captures the text, and
+// report_cache_end() stores it.
+#define REPORT_CACHE_SLOTS 32
+#define REPORT_CACHE_MAX_OUTPUT (256 * 1024)
+
+// Function prototypes
+int report_cache_begin(ReportType type, const ReportParams* params);
+void report_cache_end();
+void report_cache_abandon();
+void report_printf(const char* format, ...);
+unsigned long report_changed_at(ReportType type, const ReportParams* params);
+
+#endif
@@ -0,0 +1,417 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "script.h"
+#include "item.h"
+#include "customer.h"
+#include "report.h"
+#include "lane.h"
+#include "park.h"
+#include "journal.h"
+#include "export.h"
+
+// Headless mode: one command per line, run on the console lane through
+// the same calls the menus make. Blank lines and lines starting with #
+// are skipped.
+//
+//   customer <id>                     select the customer
+//   add <item id> <quantity>          add to the cart
+//   remove <item id>                  take a line out of the cart
+//   clear                             empty the cart
+//   checkout                          generate the receipt
+//   park / resume <ticket>            park or resume the cart
+//   return <receipt> <item> <qty>...  refund items from a sale
+//   report <name> [arguments]         write a report's rows
+//   checkpoint                        fold the journal into the data files
+//
+// Each command writes one JSON object to the results stream, with the
+// input line number, the command and "status" of "ok" or "error". Report
+// rows come before their command's status line. A summary line ends the
+// run.
+//
+// A checkout's "ok" is written once its journal record is on disk, as at
+// the till. In batch mode the journal is instead flushed only at the end
+// of the run and at each checkpoint command, which is much faster but
+// means an "ok" before that point is not yet durable: a crash loses
+// those sales. If the final flush fails, the summary counts it as an
+// error and nothing from the run is saved.
+
+#define MAX_SCRIPT_LINE 256
+#define MAX_RESULT_FIELDS 8
+
+static Exporter results;
+static const char* result_keys[MAX_RESULT_FIELDS];
+static int script_errors;
+static int batch_mode;
+
+// Keeps stdout for results and sends everything else printed, from the
+// loading messages to the menus' own error text, to stderr
+FILE* claim_stdout() {
+    fflush(stdout);
+    int fd = dup(STDOUT_FILENO);
+    FILE* stream = fd >= 0 ? fdopen(fd, "w") : NULL;
+    if (stream == NULL || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+        fprintf(stderr, "Error: Cannot set up script output.\n");
+        exit(1);
+    }
+    return stream;
+}
+
+// Result fields differ by command, so each key is named as it is written
+static void result_key(const char* name) {
+    if (results.field < MAX_RESULT_FIELDS) {
+        result_keys[results.field] = name;
+    }
+}
+
+static void result_str(const char* name, const char* value) {
+    result_key(name);
+    export_str(&results, value);
+}
+
+static void result_int(const char* name, long long value) {
+    result_key(name);
+    export_int(&results, value);
+}
+
+static void result_money(const char* name, money_t value) {
+    result_key(name);
+    export_money(&results, value);
+}
+
+static void result_begin(int line_number, const char* command, int ok) {
+    export_row_begin(&results);
+    result_int("line", line_number);
+    result_str("command", command);
+    result_str("status", ok ? "ok" : "error");
+}
+
+static void result_error(int line_number, const char* command, const char* message) {
+    result_begin(line_number, command, 0);
+    result_str("error", message);
+    export_row_end(&results);
+    script_errors++;
+}
+
+static void result_ok(int line_number, const char* command) {
+    result_begin(line_number, command, 1);
+    export_row_end(&results);
+}
+
+static void result_receipt(int line_number, const char* command, const Receipt* receipt) {
+    result_begin(line_number, command, 1);
+    result_str("receipt", receipt->receipt_id);
+    result_int("customer", receipt->customer_id);
+    result_money("total", receipt->total_amount);
+    result_money("discount", receipt->discount_amount);
+    result_money("tax", receipt->tax_amount);
+    export_row_end(&results);
+}
+
+static const struct {
+    const char* name;
+    ReportType type;
+} report_names[] = {
+    {"daily-sales", REPORT_DAILY_SALES},
+    {"customer-history", REPORT_CUSTOMER_HISTORY},
+    {"item-sales", REPORT_ITEM_SALES},
+    {"market-basket", REPORT_MARKET_BASKET},
+    {"distinct-customers", REPORT_DISTINCT_CUSTOMERS},
+    {"basket-value", REPORT_BASKET_VALUE},
+    {"hourly-heatmap", REPORT_HOURLY_HEATMAP},
+    {"receipt-history", REPORT_RECEIPT_HISTORY},
+    {"item-history", REPORT_ITEM_HISTORY},
+    {"inventory", REPORT_INVENTORY}
+};
+
+// report <name> [arguments]: dates default to today, as in the menus.
+//   daily-sales [date]
+//   customer-history [customer id, else the selected customer]
+//   distinct-customers [from] [to] [item id]
+//   basket-value [from] [to]
+//   inventory [low-stock threshold]
+static void run_report(int line_number, const char* arguments, Lane* lane) {
+    char name[32], first[MAX_DATE_LEN] = "", second[MAX_DATE_LEN] = "";
+    int number = 0;
+    int given = sscanf(arguments, "%31s %14s %14s %d", name, first, second, &number);
+    if (given < 1) {
+        result_error(line_number, "report", "missing report name");
+        return;
+    }
+
+    int found = -1;
+    for (int i = 0; i < (int)(sizeof(report_names) / sizeof(report_names[0])); i++) {
+        if (strcmp(name, report_names[i].name) == 0) {
+            found = i;
+        }
+    }
+    if (found < 0) {
+        result_error(line_number, "report", "unknown report");
+        return;
+    }
+
+    ReportParams params = {"", "", 0, 0, 20};
+    ReportType type = report_names[found].type;
+    switch (type) {
+        case REPORT_CUSTOMER_HISTORY:
+            if (given >= 2) {
+                params.customer_id = atoi(first);
+            } else if (lane->customer) {
+                params.customer_id = lane->customer->id;
+            } else {
+                result_error(line_number, "report", "no customer selected");
+                return;
+            }
+            break;
+        case REPORT_INVENTORY:
+            if (given >= 2) {
+                params.threshold = atoi(first);
+            }
+            break;
+        default:
+            strcpy(params.from_date, first);
+            strcpy(params.to_date, second);
+            params.item_id = given >= 4 ? number : 0;
+            break;
+    }
+    if (strlen(params.from_date) == 0) {
+        get_current_date(params.from_date);
+    }
+    if (strlen(params.to_date) == 0) {
+        get_current_date(params.to_date);
+    }
+
+    // The report writes to the same stream, so results so far go first
+    export_flush(&results);
+    int rows = export_report_to(type, &params, EXPORT_JSONL, results.file);
+    if (rows < 0) {
+        result_error(line_number, "report", "report failed");
+        return;
+    }
+    result_begin(line_number, "report", 1);
+    result_str("report", name);
+    result_int("rows", rows);
+    export_row_end(&results);
+}
+
+// return <receipt> <item> <quantity> [<item> <quantity>...]
+static void run_return(int line_number, char* arguments) {
+    char* receipt_id = strtok(arguments, " \t");
+    if (receipt_id == NULL) {
+        result_error(line_number, "return", "missing receipt ID");
+        return;
+    }
+
+    ReturnLine returns[MAX_SCRIPT_LINE / 4];
+    int count = 0;
+    char* item;
+    while ((item = strtok(NULL, " \t")) != NULL) {
+        if (count == (int)(sizeof(returns) / sizeof(returns[0]))) {
+            result_error(line_number, "return", "too many items to return");
+            return;
+        }
+        char* quantity = strtok(NULL, " \t");
+        if (quantity == NULL) {
+            result_error(line_number, "return", "item without a quantity");
+            return;
+        }
+        returns[count].item_id = atoi(item);
+        returns[count].quantity = atoi(quantity);
+        count++;
+    }
+    if (count == 0) {
+        result_error(line_number, "return", "nothing to return");
+        return;
+    }
+
+    Receipt refund;
+    if (!refund_receipt(receipt_id, returns, count, &refund, 0)) {
+        result_error(line_number, "return", "return rejected");
+        return;
+    }
+    result_receipt(line_number, "return", &refund);
+}
+
+static void run_command(int line_number, char* text, Lane* lane, int* checkouts) {
+    char command[16];
+    int offset = 0;
+    if (sscanf(text, "%15s %n", command, &offset) != 1) {
+        return;
+    }
+    char* arguments = text + offset;
+    int a, b;
+
+    if (strcmp(command, "customer") == 0) {
+        Customer* customer = sscanf(arguments, "%d", &a) == 1 ? find_customer_by_id(a) : NULL;
+        if (customer == NULL) {
+            result_error(line_number, command, "customer not found");
+            return;
+        }
+        lane->customer = customer;
+        result_begin(line_number, command, 1);
+        result_int("customer", customer->id);
+        result_str("name", customer->name);
+        export_row_end(&results);
+    } else if (strcmp(command, "add") == 0) {
+        if (sscanf(arguments, "%d %d", &a, &b) != 2) {
+            result_error(line_number, command, "expected item ID and quantity");
+        } else if (!add_to_cart(&lane->cart, a, b)) {
+            result_error(line_number, command, "cannot add item");
+        } else {
+            result_begin(line_number, command, 1);
+            result_int("item", a);
+            result_int("quantity", b);
+            result_int("cart_units", get_cart_units(&lane->cart));
+            export_row_end(&results);
+        }
+    } else if (strcmp(command, "remove") == 0) {
+        if (sscanf(arguments, "%d", &a) != 1 || !remove_from_cart(&lane->cart, a)) {
+            result_error(line_number, command, "item not in cart");
+        } else {
+            result_ok(line_number, command);
+        }
+    } else if (strcmp(command, "clear") == 0) {
+        clear_cart(&lane->cart);
+        result_ok(line_number, command);
+    } else if (strcmp(command, "checkout") == 0) {
+        Receipt receipt;
+        if (!lane->customer) {
+            result_error(line_number, command, "no customer selected");
+        } else if (is_cart_empty(&lane->cart)) {
+            result_error(line_number, command, "cart is empty");
+        } else if (!generate_receipt(lane, &receipt, 0)) {
+            result_error(line_number, command, "checkout failed");
+        } else {
+            result_receipt(line_number, command, &receipt);
+            (*checkouts)++;
+        }
+    } else if (strcmp(command, "park") == 0) {
+        int ticket = park_cart(lane);
+        if (ticket == 0) {
+            result_error(line_number, command, "cart is empty");
+            return;
+        }
+        lane->customer = NULL;
+        result_begin(line_number, command, 1);
+        result_int("ticket", ticket);
+        export_row_end(&results);
+    } else if (strcmp(command, "resume") == 0) {
+        if (!is_cart_empty(&lane->cart)) {
+            result_error(line_number, command, "cart is not empty");
+        } else if (sscanf(arguments, "%d", &a) != 1 || !resume_cart(lane, a)) {
+            result_error(line_number, command, "no parked cart with that ticket, or it has expired");
+        } else {
+            result_begin(line_number, command, 1);
+            result_int("ticket", a);
+            result_int("cart_units", get_cart_units(&lane->cart));
+            export_row_end(&results);
+        }
+    } else if (strcmp(command, "return") == 0) {
+        run_return(line_number, arguments);
+    } else if (strcmp(command, "report") == 0) {
+        run_report(line_number, arguments, lane);
+    } else if (strcmp(command, "checkpoint") == 0) {
+        if (batch_mode && !journal_end_batch()) {
+            result_error(line_number, command, "cannot write the journal");
+        } else {
+            lock_store();
+            checkpoint_store();
+            unlock_store();
+            result_ok(line_number, command);
+        }
+        if (batch_mode) {
+            journal_begin_batch();
+        }
+    } else {
+        result_error(line_number, command, "unknown command");
+    }
+}
+
+// Runs the commands in path ("-" for stdin) and writes their results to
+// the results stream, then checkpoints. With batch set, the journal is
+// flushed once at the end rather than after every checkout, as for order
+// files. Results are buffered unless the commands come from a terminal.
+// Returns the exit status: 0 if every command succeeded.
+int run_script(const char* path, int batch, FILE* results_stream) {
+    FILE* input = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if (input == NULL) {
+        fprintf(stderr, "Error: Cannot open script %s.\n", path);
+        return 1;
+    }
+    if (!export_attach(&results, results_stream, EXPORT_JSONL)) {
+        return 1;
+    }
+    export_columns(&results, result_keys, MAX_RESULT_FIELDS);
+    int interactive = isatty(fileno(input));
+
+    Lane* lane = current_lane;
+    char text[MAX_SCRIPT_LINE];
+    int line_number = 0, commands = 0, checkouts = 0;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    batch_mode = batch;
+    if (batch_mode) {
+        journal_begin_batch();
+    }
+    while (fgets(text, sizeof(text), input) != NULL) {
+        line_number++;
+        // Running the part of an overlong line that fit would drop the
+        // rest, such as further items of a return, so it is skipped
+        int truncated = 0;
+        if (text[strcspn(text, "\n")] == '\0') {
+            int c = fgetc(input);
+            truncated = c != EOF && c != '\n';
+            while (c != EOF && c != '\n') {
+                c = fgetc(input);
+            }
+        }
+        text[strcspn(text, "\r\n")] = '\0';
+        char* command = text + strspn(text, " \t");
+        if (*command == '\0' || *command == '#') {
+            continue;
+        }
+        if (truncated) {
+            char name[16] = "";
+            sscanf(command, "%15s", name);
+            result_error(line_number, name, "line too long");
+            commands++;
+            continue;
+        }
+        run_command(line_number, command, lane, &checkouts);
+        commands++;
+        if (interactive) {
+            export_flush(&results);
+        }
+    }
+    if (batch_mode && !journal_end_batch()) {
+        script_errors++;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    // A cart still open at the end is released, not sold
+    clear_cart(&lane->cart);
+    lock_store();
+    checkpoint_store();
+    unlock_store();
+
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    export_row_begin(&results);
+    result_str("command", "summary");
+    result_int("commands", commands);
+    result_int("errors", script_errors);
+    result_int("checkouts", checkouts);
+    result_key("seconds");
+    export_fixed(&results, seconds, 6);
+    result_key("checkouts_per_second");
+    export_fixed(&results, seconds > 0 ? checkouts / seconds : 0.0, 0);
+    export_row_end(&results);
+    export_close(&results);
+
+    if (input != stdin) {
+        fclose(input);
+    }
+    return script_errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,10 @@
+#ifndef SCRIPT_H
+#define SCRIPT_H
+
+#include <stdio.h>
+
+// Function prototypes
+FILE* claim_stdout();
+int run_script(const char* path, int batch, FILE* results);
+
+#endif
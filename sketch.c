@@ -0,0 +1,226 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sketch.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+void hll_init(HyperLogLog* hll) {
+    memset(hll->registers, 0, sizeof(hll->registers));
+}
+
+void hll_add(HyperLogLog* hll, uint64_t hash) {
+    unsigned index = (unsigned)(hash >> (64 - HLL_PRECISION));
+    uint64_t rest = hash << HLL_PRECISION;
+
+    // Rank is the position of the first set bit in the remaining bits
+    unsigned char rank = 1;
+    while (rank <= 64 - HLL_PRECISION && !(rest & 0x8000000000000000ULL)) {
+        rest <<= 1;
+        rank++;
+    }
+    if (rank > hll->registers[index]) {
+        hll->registers[index] = rank;
+    }
+}
+
+void hll_merge(HyperLogLog* dst, const HyperLogLog* src) {
+    for (int i = 0; i < HLL_REGISTERS; i++) {
+        if (src->registers[i] > dst->registers[i]) {
+            dst->registers[i] = src->registers[i];
+        }
+    }
+}
+
+double hll_estimate(const HyperLogLog* hll) {
+    const double m = HLL_REGISTERS;
+    double sum = 0;
+    int zeros = 0;
+
+    for (int i = 0; i < HLL_REGISTERS; i++) {
+        sum += ldexp(1.0, -hll->registers[i]);
+        if (hll->registers[i] == 0) {
+            zeros++;
+        }
+    }
+
+    double alpha = 0.7213 / (1.0 + 1.079 / m);
+    double estimate = alpha * m * m / sum;
+
+    // Linear counting is more accurate while many registers are empty
+    if (estimate <= 2.5 * m && zeros > 0) {
+        estimate = m * log(m / zeros);
+    }
+    return estimate;
+}
+
+double hll_standard_error() {
+    return 1.04 / sqrt((double)HLL_REGISTERS);
+}
+
+void compact_hll_init(CompactHyperLogLog* hll) {
+    hll->exact_count = 0;
+    hll->dense = NULL;
+}
+
+// Returns 0 if the registers were needed and could not be allocated
+int compact_hll_add(CompactHyperLogLog* hll, uint64_t hash) {
+    if (hll->dense != NULL) {
+        hll_add(hll->dense, hash);
+        return 1;
+    }
+    for (int i = 0; i < hll->exact_count; i++) {
+        if (hll->exact[i] == hash) {
+            return 1;
+        }
+    }
+    if (hll->exact_count < HLL_EXACT_HASHES) {
+        hll->exact[hll->exact_count++] = hash;
+        return 1;
+    }
+
+    hll->dense = malloc(sizeof(HyperLogLog));
+    if (hll->dense == NULL) {
+        return 0;
+    }
+    hll_init(hll->dense);
+    for (int i = 0; i < hll->exact_count; i++) {
+        hll_add(hll->dense, hll->exact[i]);
+    }
+    hll_add(hll->dense, hash);
+    return 1;
+}
+
+void compact_hll_merge_into(HyperLogLog* dst, const CompactHyperLogLog* src) {
+    if (src->dense != NULL) {
+        hll_merge(dst, src->dense);
+        return;
+    }
+    for (int i = 0; i < src->exact_count; i++) {
+        hll_add(dst, src->exact[i]);
+    }
+}
+
+void compact_hll_free(CompactHyperLogLog* hll) {
+    free(hll->dense);
+    compact_hll_init(hll);
+}
+
+void tdigest_init(TDigest* digest) {
+    digest->count = 0;
+    digest->merged = 0;
+    digest->total_weight = 0;
+    digest->min = 0;
+    digest->max = 0;
+}
+
+static int compare_centroid(const void* a, const void* b) {
+    double x = ((const Centroid*)a)->mean;
+    double y = ((const Centroid*)b)->mean;
+    return (x > y) - (x < y);
+}
+
+// k1 scale function: centroids stay small near the tails
+static double tdigest_scale(double q) {
+    return TDIGEST_COMPRESSION / (2.0 * M_PI) * asin(2.0 * q - 1.0);
+}
+
+void tdigest_compress(TDigest* digest) {
+    if (digest->merged == digest->count) {
+        return;
+    }
+    qsort(digest->centroids, digest->count, sizeof(Centroid), compare_centroid);
+
+    double total = digest->total_weight;
+    double weight_before = 0;
+    double k_left = tdigest_scale(0);
+    Centroid current = digest->centroids[0];
+    int out = 0;
+
+    for (int i = 1; i < digest->count; i++) {
+        Centroid next = digest->centroids[i];
+        double proposed = current.weight + next.weight;
+        if (tdigest_scale((weight_before + proposed) / total) - k_left <= 1.0) {
+            current.mean += (next.mean - current.mean) * next.weight / proposed;
+            current.weight = proposed;
+        } else {
+            digest->centroids[out++] = current;
+            weight_before += current.weight;
+            k_left = tdigest_scale(weight_before / total);
+            current = next;
+        }
+    }
+    digest->centroids[out++] = current;
+    digest->count = out;
+    digest->merged = out;
+}
+
+void tdigest_add(TDigest* digest, double value, double weight) {
+    if (digest->count == TDIGEST_MAX_CENTROIDS) {
+        tdigest_compress(digest);
+    }
+    if (digest->total_weight == 0 || value < digest->min) {
+        digest->min = value;
+    }
+    if (digest->total_weight == 0 || value > digest->max) {
+        digest->max = value;
+    }
+    digest->centroids[digest->count].mean = value;
+    digest->centroids[digest->count].weight = weight;
+    digest->count++;
+    digest->total_weight += weight;
+}
+
+void tdigest_merge(TDigest* dst, TDigest* src) {
+    if (src->total_weight == 0) {
+        return;
+    }
+    double min = src->min;
+    double max = src->max;
+    if (dst->total_weight > 0) {
+        if (dst->min < min) min = dst->min;
+        if (dst->max > max) max = dst->max;
+    }
+
+    tdigest_compress(src);
+    for (int i = 0; i < src->count; i++) {
+        tdigest_add(dst, src->centroids[i].mean, src->centroids[i].weight);
+    }
+    dst->min = min;
+    dst->max = max;
+}
+
+double tdigest_quantile(TDigest* digest, double q) {
+    if (digest->total_weight == 0) {
+        return 0;
+    }
+    tdigest_compress(digest);
+
+    const Centroid* c = digest->centroids;
+    int n = digest->count;
+    if (n == 1) {
+        return c[0].mean;
+    }
+
+    // Interpolate between centroid centres, using min/max at the ends
+    double target = q * digest->total_weight;
+    if (target <= c[0].weight / 2) {
+        return digest->min + (c[0].mean - digest->min) * target / (c[0].weight / 2);
+    }
+    if (target >= digest->total_weight - c[n - 1].weight / 2) {
+        double into = target - (digest->total_weight - c[n - 1].weight / 2);
+        return c[n - 1].mean + (digest->max - c[n - 1].mean) * into / (c[n - 1].weight / 2);
+    }
+
+    double center = c[0].weight / 2;
+    for (int i = 0; i < n - 1; i++) {
+        double next_center = center + (c[i].weight + c[i + 1].weight) / 2;
+        if (target <= next_center) {
+            return c[i].mean + (c[i + 1].mean - c[i].mean) * (target - center) / (next_center - center);
+        }
+        center = next_center;
+    }
+    return digest->max;
+}
@@ -0,0 +1,64 @@
+#ifndef SKETCH_H
+#define SKETCH_H
+
+#include <stdint.h>
+
+// HyperLogLog distinct counter: 2^HLL_PRECISION one-byte registers,
+// standard error about 1.04 / sqrt(registers)
+#define HLL_PRECISION 10
+#define HLL_REGISTERS (1 << HLL_PRECISION)
+
+typedef struct {
+    unsigned char registers[HLL_REGISTERS];
+} HyperLogLog;
+
+// HyperLogLog for counts that are usually tiny: up to HLL_EXACT_HASHES
+// hashes are kept as they are, and registers are only allocated past
+// that. Merged into a HyperLogLog it gives the same registers as a dense
+// one would.
+#define HLL_EXACT_HASHES 8
+
+typedef struct {
+    int exact_count;
+    uint64_t exact[HLL_EXACT_HASHES];
+    HyperLogLog* dense;       // NULL while the hashes fit in exact
+} CompactHyperLogLog;
+
+// Merging t-digest for streaming quantiles. Centroids past `merged` are
+// an unsorted buffer of new points, folded in when the array fills up.
+#define TDIGEST_COMPRESSION 100
+#define TDIGEST_MAX_CENTROIDS 320
+
+typedef struct {
+    double mean;
+    double weight;
+} Centroid;
+
+typedef struct {
+    Centroid centroids[TDIGEST_MAX_CENTROIDS];
+    int count;
+    int merged;
+    double total_weight;
+    double min;
+    double max;
+} TDigest;
+
+// Function prototypes
+void hll_init(HyperLogLog* hll);
+void hll_add(HyperLogLog* hll, uint64_t hash);
+void hll_merge(HyperLogLog* dst, const HyperLogLog* src);
+double hll_estimate(const HyperLogLog* hll);
+double hll_standard_error();
+
+void compact_hll_init(CompactHyperLogLog* hll);
+int compact_hll_add(CompactHyperLogLog* hll, uint64_t hash);
+void compact_hll_merge_into(HyperLogLog* dst, const CompactHyperLogLog* src);
+void compact_hll_free(CompactHyperLogLog* hll);
+
+void tdigest_init(TDigest* digest);
+void tdigest_add(TDigest* digest, double value, double weight);
+void tdigest_merge(TDigest* dst, TDigest* src);
+void tdigest_compress(TDigest* digest);
+double tdigest_quantile(TDigest* digest, double q);
+
+#endif